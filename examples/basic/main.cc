@@ -1,6 +1,7 @@
 #include <bitset>
 #include <iostream>
 
+#include "p4buf/format.h"
 #include "p4buf/p4data.h"
 
 using namespace p4buf;
@@ -47,5 +48,10 @@ int main(int argc, char* argv[]) {
   // abbcccdd dd.t[0]. .t[1]
   PrintBuffer(*p4data.buffer());
 
+  // Print the fields, which formats much faster than the bits above:
+  // /a=0x1 /b=0x1 /s/c=0x1 /s/d=0x1 /t/0=0x01 /t/1=0x01
+  P4DataFormatter formatter(*p4data.layout());
+  std::cout << formatter.Format(p4data) << "\n";
+
   return 0;
 }
@@ -0,0 +1,22 @@
+#include "p4buf/batch.h"
+
+#include "absl/log/check.h"
+
+namespace p4buf {
+
+P4DataBatch::P4DataBatch(std::shared_ptr<const P4Layout> layout,
+                         std::size_t size, std::optional<uint8_t> init_val)
+    : layout_(std::move(layout)) {
+  records_.reserve(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    records_.emplace_back(layout_, init_val);
+  }
+}
+
+void P4DataBatch::Add(P4Data p4data) {
+  CHECK(p4data.layout()->SameType(*layout_))
+      << "P4DataBatch: record of another type";
+  records_.push_back(std::move(p4data));
+}
+
+}  // namespace p4buf
@@ -0,0 +1,61 @@
+// Batches of P4 data records.
+
+#ifndef P4BUF_BATCH_H_
+#define P4BUF_BATCH_H_
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// P4 data batch holds records of the same layout, in order.
+class P4DataBatch {
+ public:
+  explicit P4DataBatch(std::shared_ptr<const P4Layout> layout)
+      : layout_(std::move(layout)) {}
+
+  // Creates a batch of the given number of records, optionally setting all
+  // bytes to the given initial value.
+  P4DataBatch(std::shared_ptr<const P4Layout> layout, std::size_t size,
+              std::optional<uint8_t> init_val = std::nullopt);
+
+  // Appends a new record, and returns a reference to it.
+  P4Data& Add(std::optional<uint8_t> init_val = std::nullopt) {
+    return records_.emplace_back(layout_, init_val);
+  }
+
+  // Appends an existing record, which must be of the same type as the layout.
+  void Add(P4Data p4data);
+
+  // Returns a pointer to the contiguous records.
+  P4Data* data() { return records_.data(); }
+  const P4Data* data() const { return records_.data(); }
+
+  P4Data& operator[](std::size_t index) { return records_[index]; }
+  const P4Data& operator[](std::size_t index) const { return records_[index]; }
+
+  std::vector<P4Data>::iterator begin() { return records_.begin(); }
+  std::vector<P4Data>::iterator end() { return records_.end(); }
+  std::vector<P4Data>::const_iterator begin() const { return records_.begin(); }
+  std::vector<P4Data>::const_iterator end() const { return records_.end(); }
+
+  void Clear() { records_.clear(); }
+
+  std::size_t size() const { return records_.size(); }
+
+  bool empty() const { return records_.empty(); }
+
+  std::shared_ptr<const P4Layout> layout() const { return layout_; }
+
+ private:
+  std::shared_ptr<const P4Layout> layout_;
+  std::vector<P4Data> records_;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_BATCH_H_
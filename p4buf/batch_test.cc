@@ -0,0 +1,37 @@
+#include "p4buf/batch.h"
+
+#include <gtest/gtest.h>
+
+namespace p4buf {
+
+TEST(P4DataBatchTest, Add) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{4}},
+      {"b", P4BitT{8}},
+  });
+  auto layout = std::make_shared<const P4Layout>(p4type);
+  P4DataBatch batch(layout, 2, 0);
+  EXPECT_EQ(batch.size(), 2);
+
+  batch.Add(0xff)["a"] = uint8_t{0x1};
+  EXPECT_EQ(batch.size(), 3);
+  EXPECT_EQ(batch[2]["a"].Load<uint8_t>(), 0x1);
+  EXPECT_EQ(batch[2]["b"].Load<uint8_t>(), 0xff);
+
+  // Another layout of the same type is fine.
+  P4Data p4data(std::make_shared<const P4Layout>(p4type), 0);
+  p4data["b"] = uint8_t{0x23};
+  batch.Add(p4data);
+  ASSERT_EQ(batch.size(), 4);
+  EXPECT_TRUE(batch[3] == p4data);
+
+  // Same width, but another type.
+  P4Data other(P4Type(P4StructT{
+                   {"a", P4BitT{8}},
+                   {"b", P4BitT{4}},
+               }),
+               0);
+  EXPECT_DEATH(batch.Add(other), "another type");
+}
+
+}  // namespace p4buf
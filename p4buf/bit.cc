@@ -1,5 +1,11 @@
 #include "p4buf/bit.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "absl/base/internal/endian.h"
+
 namespace p4buf {
 namespace {
 
@@ -90,9 +96,178 @@ void BitMemCpy(std::byte* dest, const std::byte* src, std::size_t dest_offset,
   // Read and write the remaining few bits.
   if (count > 0) {
     // It's okay to read a whole byte. We just need to limit bits in write.
-    auto byte = ReadOneByte(src, src_offset);
+    // But don't touch the next source byte if no remaining bit lives there.
+    auto byte = (src_offset % 8 + count > 8)
+                    ? ReadOneByte(src, src_offset)
+                    : (src[src_offset / 8] << (src_offset % 8));
     WriteSomeBits(dest, dest_offset, byte, count);
   }
 }
 
+uint64_t BitLoad(const std::byte* src, std::size_t src_offset,
+                 std::size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  src += src_offset / 8;
+  src_offset %= 8;
+
+  // Read the covered bytes (at most 9) into a left-aligned word.
+  std::size_t num_bytes = (src_offset + count + 7) / 8;
+  uint64_t word = 0;
+  if (num_bytes >= 8) {
+    word = absl::big_endian::Load64(src);
+  } else {
+    for (std::size_t i = 0; i < num_bytes; ++i) {
+      word = (word << 8) | std::to_integer<uint64_t>(src[i]);
+    }
+    word <<= (8 - num_bytes) * 8;
+  }
+
+  // Drop the leading bits, and pull in the trailing ones from the 9th byte.
+  word <<= src_offset;
+  if (num_bytes > 8) {
+    word |= std::to_integer<uint64_t>(src[8]) >> (8 - src_offset);
+  }
+
+  return word >> (64 - count);
+}
+
+void BitLoadWords(const std::byte* src, std::size_t src_offset,
+                  std::size_t count, uint64_t* words, std::size_t num_words) {
+  // Walk from the least significant end.
+  for (std::size_t i = num_words; i > 0; --i) {
+    std::size_t bits = std::min<std::size_t>(count, 64);
+    count -= bits;
+    words[i - 1] = BitLoad(src, src_offset + count, bits);
+  }
+}
+
+int BitMemCmp(const std::byte* lhs, std::size_t lhs_offset,
+              const std::byte* rhs, std::size_t rhs_offset, std::size_t count) {
+  // Byte-aligned full bytes compare as bytes.
+  if (lhs_offset % 8 == 0 && rhs_offset % 8 == 0) {
+    std::size_t num_bytes = count / 8;
+    if (num_bytes > 0) {
+      int result =
+          std::memcmp(lhs + lhs_offset / 8, rhs + rhs_offset / 8, num_bytes);
+      if (result != 0) {
+        return result;
+      }
+    }
+    lhs_offset += num_bytes * 8;
+    rhs_offset += num_bytes * 8;
+    count -= num_bytes * 8;
+  }
+
+  // Compare words, and then the remaining few bits.
+  while (count > 0) {
+    std::size_t width = count < 64 ? count : 64;
+    uint64_t lhs_word = BitLoad(lhs, lhs_offset, width);
+    uint64_t rhs_word = BitLoad(rhs, rhs_offset, width);
+    if (lhs_word != rhs_word) {
+      return lhs_word < rhs_word ? -1 : 1;
+    }
+    lhs_offset += width;
+    rhs_offset += width;
+    count -= width;
+  }
+  return 0;
+}
+
+void BitStore(std::byte* dest, std::size_t dest_offset, std::size_t count,
+              uint64_t value) {
+  if (count == 0) {
+    return;
+  }
+
+  dest += dest_offset / 8;
+  dest_offset %= 8;
+
+  // Left-align the value and its mask, then shift them to the bit offset.
+  uint64_t field = value << (64 - count);
+  uint64_t mask = ~uint64_t{0} << (64 - count);
+  uint64_t word_field = field >> dest_offset;
+  uint64_t word_mask = mask >> dest_offset;
+
+  // Merge into the covered bytes (at most 9) of the destination.
+  std::size_t num_bytes = (dest_offset + count + 7) / 8;
+  if (num_bytes >= 8) {
+    uint64_t word = absl::big_endian::Load64(dest);
+    word = (word & ~word_mask) | word_field;
+    absl::big_endian::Store64(dest, word);
+  } else {
+    for (std::size_t i = 0; i < num_bytes; ++i) {
+      std::size_t shift = 56 - i * 8;
+      auto byte_mask = std::byte(word_mask >> shift);
+      dest[i] = (dest[i] & ~byte_mask) | std::byte(word_field >> shift);
+    }
+  }
+  if (num_bytes > 8) {
+    // The trailing bits spill over into the 9th byte.
+    auto byte_mask = std::byte(mask << (64 - dest_offset) >> 56);
+    dest[8] = (dest[8] & ~byte_mask) |
+              std::byte(field << (64 - dest_offset) >> 56);
+  }
+}
+
+void BitStoreWords(std::byte* dest, std::size_t dest_offset, std::size_t count,
+                   const uint64_t* words, std::size_t num_words) {
+  // Walk from the least significant end.
+  for (std::size_t i = num_words; i > 0 && count > 0; --i) {
+    std::size_t bits = std::min<std::size_t>(count, 64);
+    count -= bits;
+    BitStore(dest, dest_offset + count, bits, words[i - 1]);
+  }
+  for (; count >= 64; count -= 64) {
+    BitStore(dest, dest_offset + count - 64, 64, 0);
+  }
+  BitStore(dest, dest_offset, count, 0);
+}
+
+void BitMemMove(std::byte* dest, const std::byte* src, std::size_t dest_offset,
+                std::size_t src_offset, std::size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  // Compare bit addresses to detect a destination overlapping the source from
+  // behind, the only case that has to be copied backward.
+  auto dest_begin = reinterpret_cast<std::uintptr_t>(dest) * 8 + dest_offset;
+  auto src_begin = reinterpret_cast<std::uintptr_t>(src) * 8 + src_offset;
+  if (dest_begin == src_begin) {
+    return;
+  }
+  bool backward = src_begin < dest_begin && dest_begin < src_begin + count;
+
+  if (dest_offset % 8 == src_offset % 8) {
+    // Same bit phase: save the partial head and tail bytes first, then
+    // std::memmove the whole bytes in between.
+    std::size_t head = std::min((8 - src_offset % 8) % 8, count);
+    std::size_t num_bytes = (count - head) / 8;
+    std::size_t tail = (count - head) % 8;
+    uint64_t head_bits = BitLoad(src, src_offset, head);
+    uint64_t tail_bits = BitLoad(src, src_offset + count - tail, tail);
+    std::memmove(dest + (dest_offset + head) / 8, src + (src_offset + head) / 8,
+                 num_bytes);
+    BitStore(dest, dest_offset, head, head_bits);
+    BitStore(dest, dest_offset + count - tail, tail, tail_bits);
+  } else if (!backward) {
+    // Copy forward, 64 bits at a time. With overlapping ranges, each source
+    // word is read before the writes reach it.
+    for (; count >= 64; src_offset += 64, dest_offset += 64, count -= 64) {
+      BitStore(dest, dest_offset, 64, BitLoad(src, src_offset, 64));
+    }
+    BitStore(dest, dest_offset, count, BitLoad(src, src_offset, count));
+  } else {
+    // Copy backward, from the last word on.
+    for (; count >= 64; count -= 64) {
+      BitStore(dest, dest_offset + count - 64, 64,
+               BitLoad(src, src_offset + count - 64, 64));
+    }
+    BitStore(dest, dest_offset, count, BitLoad(src, src_offset, count));
+  }
+}
+
 }  // namespace p4buf
@@ -4,6 +4,7 @@
 #define P4BUF_BIT_H_
 
 #include <cstddef>
+#include <cstdint>
 
 namespace p4buf {
 
@@ -14,6 +15,46 @@ namespace p4buf {
 void BitMemCpy(std::byte* dest, const std::byte* src, std::size_t dest_offset,
                std::size_t src_offset, std::size_t count);
 
+// Same as BitMemCpy, but the source and destination ranges may overlap, like
+// std::memmove. Overlapping ranges are copied forward or backward so that each
+// source bit is read before being overwritten.
+void BitMemMove(std::byte* dest, const std::byte* src, std::size_t dest_offset,
+                std::size_t src_offset, std::size_t count);
+
+// Returns count (at most 64) bits from the byte array pointed to by src (with
+// src_offset in bits), right-aligned in an integer. For example:
+//
+//   BitLoad({0b0001'1010}, 3, 4) => 0b1101
+//
+// Only the bytes covering the given bits are read.
+uint64_t BitLoad(const std::byte* src, std::size_t src_offset,
+                 std::size_t count);
+
+// Reads count bits from the byte array pointed to by src (with src_offset in
+// bits) into num_words words, as a right-aligned wide integer with the most
+// significant word first. Bits beyond num_words words are dropped, and words
+// beyond count bits are set to 0.
+void BitLoadWords(const std::byte* src, std::size_t src_offset,
+                  std::size_t count, uint64_t* words, std::size_t num_words);
+
+// Compares count bits from the byte array pointed to by lhs (with lhs_offset in
+// bits) with those from rhs (with rhs_offset in bits), from the most
+// significant bit on, 64 bits at a time. Returns a negative value, 0 or a
+// positive value like std::memcmp.
+int BitMemCmp(const std::byte* lhs, std::size_t lhs_offset,
+              const std::byte* rhs, std::size_t rhs_offset, std::size_t count);
+
+// Stores the lowest count (at most 64) bits of value into the byte array
+// pointed to by dest (with dest_offset in bits). Other bits are left intact.
+void BitStore(std::byte* dest, std::size_t dest_offset, std::size_t count,
+              uint64_t value);
+
+// Stores the lowest count bits of a wide integer of num_words words, with the
+// most significant word first, into the byte array pointed to by dest (with
+// dest_offset in bits). Bits beyond num_words words are set to 0.
+void BitStoreWords(std::byte* dest, std::size_t dest_offset, std::size_t count,
+                   const uint64_t* words, std::size_t num_words);
+
 }  // namespace p4buf
 
 #endif  // P4BUF_BIT_H_
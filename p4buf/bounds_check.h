@@ -0,0 +1,63 @@
+// Bounds checking policies for accessors.
+
+#ifndef P4BUF_BOUNDS_CHECK_H_
+#define P4BUF_BOUNDS_CHECK_H_
+
+#include <cstddef>
+
+#include "absl/log/check.h"
+
+// The default bounds checking policy, as the value of a BoundsCheck. It can be
+// set for a build, like --copt=-DP4BUF_BOUNDS_CHECK=1 for BoundsCheck::kDebug.
+#ifndef P4BUF_BOUNDS_CHECK
+#define P4BUF_BOUNDS_CHECK 2
+#endif
+
+namespace p4buf {
+
+// Accessors of Buffer, BitField and P4Data take a bounds checking policy as a
+// template parameter, defaulting to kDefaultBoundsCheck. Hot loops over
+// validated indices may opt out of the checks with kNever.
+enum class BoundsCheck {
+  // Never checks. Out-of-bounds accesses are undefined behavior.
+  kNever = 0,
+  // Checks in debug builds only, where NDEBUG is not defined.
+  kDebug = 1,
+  // Always checks.
+  kAlways = 2,
+};
+
+inline constexpr BoundsCheck kDefaultBoundsCheck =
+    static_cast<BoundsCheck>(P4BUF_BOUNDS_CHECK);
+
+// Returns whether bounds are checked under the policy in this build.
+constexpr bool IsBoundsChecked(BoundsCheck check) {
+#ifdef NDEBUG
+  return check == BoundsCheck::kAlways;
+#else
+  return check != BoundsCheck::kNever;
+#endif
+}
+
+// Accesses the element at the given index of a container, like std::vector.
+// Throws std::out_of_range if it is out of bounds, and bounds are checked under
+// the policy.
+template <BoundsCheck kCheck, typename Container>
+decltype(auto) CheckedAt(Container& container, std::size_t index) {
+  if constexpr (IsBoundsChecked(kCheck)) {
+    return container.at(index);
+  } else {
+    return container[index];
+  }
+}
+
+}  // namespace p4buf
+
+// CHECKs the condition if bounds are checked under the policy. Compiles to
+// nothing otherwise.
+#define P4BUF_CHECK_BOUNDS(check, condition)      \
+  if (!::p4buf::IsBoundsChecked(check)) {         \
+  } else                                          \
+    CHECK(condition)
+
+#endif  // P4BUF_BOUNDS_CHECK_H_
@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+
+#include "p4buf/bounds_check.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+namespace {
+
+// Sums all bytes of a buffer.
+template <BoundsCheck kCheck>
+void BM_BufferAt(benchmark::State& state) {
+  const Buffer buffer(state.range(0), 0x5a);
+
+  for (auto _ : state) {
+    uint32_t sum = 0;
+    for (std::size_t i = 0; i < buffer.size(); ++i) {
+      sum += std::to_integer<uint32_t>(buffer.at<kCheck>(i));
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK_TEMPLATE(BM_BufferAt, BoundsCheck::kAlways)->Arg(1 << 12);
+BENCHMARK_TEMPLATE(BM_BufferAt, BoundsCheck::kNever)->Arg(1 << 12);
+
+// Takes a bit field of every 13 bits of a buffer.
+template <BoundsCheck kCheck>
+void BM_BitFieldMake(benchmark::State& state) {
+  auto buffer = std::make_shared<Buffer>(state.range(0), 0x5a);
+  std::size_t num_fields = buffer->size() * 8 / 13;
+
+  for (auto _ : state) {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < num_fields; ++i) {
+      sum += BitField::Make<kCheck>(buffer, i * 13, 13).offset();
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * num_fields);
+}
+BENCHMARK_TEMPLATE(BM_BitFieldMake, BoundsCheck::kAlways)->Arg(1 << 12);
+BENCHMARK_TEMPLATE(BM_BitFieldMake, BoundsCheck::kNever)->Arg(1 << 12);
+
+// Loads every field of an IPv4-like header by position.
+template <BoundsCheck kCheck>
+void BM_P4DataAt(benchmark::State& state) {
+  const P4Data p4data(P4Type(P4StructT{
+                          {"version", P4BitT{4}},
+                          {"ihl", P4BitT{4}},
+                          {"diffserv", P4BitT{8}},
+                          {"total_len", P4BitT{16}},
+                          {"identification", P4BitT{16}},
+                          {"flags", P4BitT{3}},
+                          {"frag_offset", P4BitT{13}},
+                          {"ttl", P4BitT{8}},
+                          {"protocol", P4BitT{8}},
+                          {"hdr_checksum", P4BitT{16}},
+                          {"src_addr", P4BitT{32}},
+                          {"dst_addr", P4BitT{32}},
+                      }),
+                      0x5a);
+  const std::byte* data = p4data.buffer()->data();
+  std::size_t num_fields = p4data.layout()->num_fields();
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (std::size_t i = 0; i < num_fields; ++i) {
+      auto field = p4data.at<kCheck>(i).template field<kCheck>();
+      sum += BitLoad(data, field.offset(), field.width());
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * num_fields);
+}
+BENCHMARK_TEMPLATE(BM_P4DataAt, BoundsCheck::kAlways);
+BENCHMARK_TEMPLATE(BM_P4DataAt, BoundsCheck::kNever);
+
+}  // namespace
+}  // namespace p4buf
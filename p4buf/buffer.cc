@@ -1,34 +1,102 @@
 #include "p4buf/buffer.h"
 
+#include <algorithm>
 #include <bitset>
 #include <iostream>
 
 #include "absl/base/internal/endian.h"
+#include "absl/numeric/bits.h"
 #include "p4buf/bit.h"
 
 namespace p4buf {
 
+void Buffer::EnableDirtyTracking(std::size_t chunk_size) {
+  CHECK(chunk_size > 0);
+  std::size_t num_chunks = (size_ + chunk_size - 1) / chunk_size;
+  dirty_ = std::make_unique<DirtyMap>(
+      DirtyMap{chunk_size, std::vector<uint64_t>((num_chunks + 63) / 64, 0)});
+}
+
+void Buffer::DirtyMap::Mark(std::size_t offset, std::size_t count) {
+  std::size_t first = offset / chunk_size;
+  std::size_t last = (offset + count - 1) / chunk_size;
+  for (std::size_t chunk = first; chunk <= last; ++chunk) {
+    bits[chunk / 64] |= uint64_t{1} << (chunk % 64);
+  }
+}
+
+void Buffer::ForEachDirtyRange(
+    const std::function<void(std::size_t, std::size_t)>& visit) const {
+  if (dirty_ == nullptr) {
+    return;
+  }
+
+  // Walk set bits only, merging adjacent chunks into runs.
+  std::size_t chunk_size = dirty_->chunk_size;
+  std::size_t run_begin = 0;
+  std::size_t run_end = 0;
+  for (std::size_t i = 0; i < dirty_->bits.size(); ++i) {
+    for (uint64_t word = dirty_->bits[i]; word != 0; word &= word - 1) {
+      std::size_t chunk = i * 64 + absl::countr_zero(word);
+      std::size_t begin = chunk * chunk_size;
+      if (begin != run_end) {
+        if (run_end > run_begin) {
+          visit(run_begin, run_end - run_begin);
+        }
+        run_begin = begin;
+      }
+      run_end = std::min(begin + chunk_size, size_);
+    }
+  }
+  if (run_end > run_begin) {
+    visit(run_begin, run_end - run_begin);
+  }
+}
+
+void Buffer::ClearDirty() {
+  if (dirty_ != nullptr) {
+    std::fill(dirty_->bits.begin(), dirty_->bits.end(), 0);
+  }
+}
+
 BitField::BitField(uint16_t bytes)
     : buffer_(std::make_shared<Buffer>(2)), offset_(0), width_(16) {
   bytes = absl::ghtons(bytes);
-  std::memcpy(buffer_->data(), &bytes, buffer_->size());
+  std::memcpy(mutable_buffer_ptr()->data(), &bytes, buffer_->size());
 }
 
 BitField::BitField(uint32_t bytes)
     : buffer_(std::make_shared<Buffer>(4)), offset_(0), width_(32) {
   bytes = absl::ghtonl(bytes);
-  std::memcpy(buffer_->data(), &bytes, buffer_->size());
+  std::memcpy(mutable_buffer_ptr()->data(), &bytes, buffer_->size());
 }
 
 BitField::BitField(uint64_t bytes)
     : buffer_(std::make_shared<Buffer>(8)), offset_(0), width_(64) {
   bytes = absl::ghtonll(bytes);
-  std::memcpy(buffer_->data(), &bytes, buffer_->size());
+  std::memcpy(mutable_buffer_ptr()->data(), &bytes, buffer_->size());
 }
 
-BitField& BitField::operator=(const BitField& other) {
-  // TODO: Properly handle the case when 2 buffers are the same one.
+#ifdef ABSL_HAVE_INTRINSIC_INT128
+BitField::BitField(unsigned __int128 bytes)
+    : buffer_(std::make_shared<Buffer>(16)), offset_(0), width_(128) {
+  Store(bytes);
+}
+#endif
 
+int Compare(const BitField& lhs, const BitField& rhs) {
+  std::size_t width = std::min(lhs.width(), rhs.width());
+  if (width > 0) {
+    int result = BitMemCmp(lhs.buffer()->data(), lhs.offset(),
+                           rhs.buffer()->data(), rhs.offset(), width);
+    if (result != 0) {
+      return result;
+    }
+  }
+  return lhs.width() < rhs.width() ? -1 : lhs.width() > rhs.width() ? 1 : 0;
+}
+
+BitField& BitField::operator=(const BitField& other) {
   // Guard empty field or value.
   if (width_ == 0 || other.width() == 0) {
     return *this;
@@ -39,8 +107,11 @@ BitField& BitField::operator=(const BitField& other) {
   std::size_t this_offset = offset_ + width_ - width;
   std::size_t other_offset = other.offset() + other.width() - width;
 
-  BitMemCpy(buffer_->data(), other.buffer()->data(), this_offset, other_offset,
-            width);
+  // The fields may overlap if they share a buffer.
+  Buffer* buffer = mutable_buffer_ptr();
+  BitMemMove(buffer->data(), other.buffer()->data(), this_offset,
+             other_offset, width);
+  buffer->MarkBitsDirty(this_offset, width);
 
   return *this;
 };
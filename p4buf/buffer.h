@@ -3,23 +3,32 @@
 #ifndef P4BUF_BUFFER_H_
 #define P4BUF_BUFFER_H_
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <initializer_list>
 #include <memory>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "absl/base/config.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/check.h"
 #include "absl/strings/string_view.h"
+#include "p4buf/bit.h"
+#include "p4buf/bounds_check.h"
 
 namespace p4buf {
 
 class Buffer;
 class BitField;
 
-// Buffer owns a byte array on heap.
+// Buffer owns a byte array on heap, or views one owned elsewhere.
 class Buffer {
  public:
   // Creates an empty buffer.
@@ -27,30 +36,41 @@ class Buffer {
 
   // Creates a buffer with the given data pointer and size.
   Buffer(std::unique_ptr<std::byte[]> data, std::size_t size)
-      : data_(std::move(data)), size_(size) {}
+      : owned_data_(std::move(data)), data_(owned_data_.get()), size_(size) {}
 
   // Creates a buffer of the given size (in bytes). Optionally sets all bytes to
   // the given initial value.
   Buffer(std::size_t size, std::optional<uint8_t> init_val = std::nullopt)
-      : data_(new std::byte[size]), size_(size) {
+      : Buffer(std::unique_ptr<std::byte[]>(new std::byte[size]), size) {
     if (init_val.has_value()) {
-      std::memset(data_.get(), init_val.value(), this->size());
+      std::memset(data_, init_val.value(), this->size());
     }
   }
 
   // Creates a buffer with data copied from the given bytes.
   Buffer(std::initializer_list<uint8_t> bytes)
-      : data_(new std::byte[bytes.size()]), size_(bytes.size()) {
-    std::memcpy(data_.get(), std::data(bytes), this->size());
+      : Buffer(std::unique_ptr<std::byte[]>(new std::byte[bytes.size()]),
+               bytes.size()) {
+    std::memcpy(data_, std::data(bytes), this->size());
   }
 
-  // Creates a buffer with data copied from the other one.
-  Buffer(const Buffer& other) : data_(new std::byte[other.size()]) {
-    std::memcpy(data_.get(), other.data(), other.size());
+  // Creates a buffer with data copied from the other one, owned by this one
+  // even if the other one is a view. Dirty tracking state is copied too.
+  Buffer(const Buffer& other)
+      : Buffer(std::unique_ptr<std::byte[]>(new std::byte[other.size()]),
+               other.size()) {
+    std::memcpy(data_, other.data(), other.size());
+    if (other.dirty_ != nullptr) {
+      dirty_ = std::make_unique<DirtyMap>(*other.dirty_);
+    }
   }
 
-  // Creates a buffer with data moved from the other one.
-  Buffer(Buffer&& other) = default;
+  // Creates a buffer with data moved from the other one, leaving it empty.
+  Buffer(Buffer&& other)
+      : owned_data_(std::move(other.owned_data_)),
+        data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)),
+        dirty_(std::move(other.dirty_)) {}
 
   // Copies data from the other buffer to this one.
   Buffer& operator=(const Buffer& other) {
@@ -58,47 +78,152 @@ class Buffer {
     return *this;
   }
 
-  // Moves data from the other buffer to this one.
-  Buffer& operator=(Buffer&& other) = default;
+  // Moves data from the other buffer to this one, leaving it empty.
+  Buffer& operator=(Buffer&& other) {
+    owned_data_ = std::move(other.owned_data_);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    dirty_ = std::move(other.dirty_);
+    return *this;
+  }
 
   ~Buffer() = default;
 
-  // Returns a reference to the byte at specified index, with bounds checking.
+  // Creates a buffer viewing the given data without copying it. The data must
+  // outlive the buffer.
+  static Buffer Wrap(std::byte* data, std::size_t size) {
+    Buffer buffer;
+    buffer.data_ = data;
+    buffer.size_ = size;
+    return buffer;
+  }
+
+  // Returns a reference to the byte at specified index, with bounds checking
+  // per the default policy. Writes through it are not tracked, like data().
   std::byte& operator[](const std::size_t index) {
-    CHECK(index < size_);
+    P4BUF_CHECK_BOUNDS(kDefaultBoundsCheck, index < size_);
+    return data_[index];
+  }
+
+  // Returns a reference to the byte at specified index for writing, with
+  // bounds checking per the given policy. The byte is marked dirty.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  std::byte& mutable_at(const std::size_t index) {
+    P4BUF_CHECK_BOUNDS(kCheck, index < size_);
+    MarkDirty(index, 1);
     return data_[index];
   }
 
   // Returns a const reference to the byte at specified index, with bounds
-  // checking.
+  // checking per the given policy.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
   const std::byte& at(const std::size_t index) const {
-    CHECK(index < size_);
+    P4BUF_CHECK_BOUNDS(kCheck, index < size_);
     return data_[index];
   }
 
-  // Returns a pointer to the beginning of the data.
-  std::byte* data() const { return data_.get(); }
+  // Returns a pointer to the beginning of the data. Writes through it are not
+  // tracked, unless marked dirty explicitly.
+  std::byte* data() { return data_; }
+  const std::byte* data() const { return data_; }
 
   // Returns the size (in bytes) of the data.
   std::size_t size() const { return size_; }
 
+  // Returns whether the data is owned by this buffer, rather than viewed.
+  bool owned() const { return data_ == owned_data_.get(); }
+
+  // Starts recording which chunks (of chunk_size bytes) are written to, with
+  // no chunk dirty yet. Writes through BitField and mutable_at() are recorded.
+  void EnableDirtyTracking(std::size_t chunk_size = 1);
+
+  // Stops recording writes, and forgets dirty chunks.
+  void DisableDirtyTracking() { dirty_ = nullptr; }
+
+  // Returns whether writes are recorded.
+  bool dirty_tracking() const { return dirty_ != nullptr; }
+
+  // Marks count bytes starting from offset as dirty, if dirty tracking is
+  // enabled.
+  void MarkDirty(std::size_t offset, std::size_t count) {
+    if (dirty_ != nullptr && count > 0) {
+      dirty_->Mark(offset, count);
+    }
+  }
+
+  // Marks count bits starting from offset (in bits) as dirty, if dirty
+  // tracking is enabled.
+  void MarkBitsDirty(std::size_t offset, std::size_t count) {
+    if (dirty_ != nullptr && count > 0) {
+      dirty_->Mark(offset / 8, (offset + count + 7) / 8 - offset / 8);
+    }
+  }
+
+  // Calls visit(offset, count) for each maximal run of dirty bytes, in order.
+  // Runs are rounded to chunks, and clipped to the buffer size.
+  void ForEachDirtyRange(
+      const std::function<void(std::size_t, std::size_t)>& visit) const;
+
+  // Marks all chunks as clean.
+  void ClearDirty();
+
  private:
-  std::unique_ptr<std::byte[]> data_ = nullptr;
+  // Dirty chunk bitmap.
+  struct DirtyMap {
+    void Mark(std::size_t offset, std::size_t count);
+
+    std::size_t chunk_size;
+    std::vector<uint64_t> bits;
+  };
+
+  std::unique_ptr<std::byte[]> owned_data_ = nullptr;
+  std::byte* data_ = nullptr;
   std::size_t size_ = 0;
+  std::unique_ptr<DirtyMap> dirty_ = nullptr;
 };
 
-// Bit field references a contiguous range of bits in a buffer.
+// Fixed-size wide unsigned integer, with the most significant word first, like
+// the slots of UnpackedP4Data.
+template <std::size_t kWords>
+using WideUint = std::array<uint64_t, kWords>;
+
+// Bit field references a contiguous range of bits in a buffer. Bit fields of a
+// const buffer are read-only, and writing through them is a CHECK failure.
 class BitField {
  public:
   // Creates an empty bit field.
   BitField() = default;
 
   // Creates a bit field with given offset and width (in bits) from a buffer,
-  // with bounds checking.
+  // with bounds checking per the default policy.
   BitField(std::shared_ptr<Buffer> buffer, std::size_t offset,
            std::size_t width)
-      : buffer_(buffer), offset_(offset), width_(width) {
-    CHECK(offset_ + width_ <= buffer_->size() * 8);
+      : buffer_(std::move(buffer)), offset_(offset), width_(width) {
+    P4BUF_CHECK_BOUNDS(kDefaultBoundsCheck,
+                       offset_ + width_ <= buffer_->size() * 8);
+  }
+
+  // Same as the constructor above, with bounds checking per the given policy.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  static BitField Make(std::shared_ptr<Buffer> buffer, std::size_t offset,
+                       std::size_t width) {
+    BitField field = Make<kCheck>(
+        std::shared_ptr<const Buffer>(std::move(buffer)), offset, width);
+    field.writable_ = true;
+    return field;
+  }
+
+  // Same as above, but creates a read-only bit field of a const buffer.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  static BitField Make(std::shared_ptr<const Buffer> buffer,
+                       std::size_t offset, std::size_t width) {
+    P4BUF_CHECK_BOUNDS(kCheck, offset + width <= buffer->size() * 8);
+    BitField field;
+    field.buffer_ = std::move(buffer);
+    field.offset_ = offset;
+    field.width_ = width;
+    field.writable_ = false;
+    return field;
   }
 
   // Creates a bit field representing the whole buffer.
@@ -121,6 +246,18 @@ class BitField {
   // Creates a bit field representing the given bytes.
   BitField(uint64_t bytes);
 
+#ifdef ABSL_HAVE_INTRINSIC_INT128
+  // Creates a bit field representing the given bytes.
+  BitField(unsigned __int128 bytes);
+#endif
+
+  // Creates a bit field representing the given wide integer.
+  template <std::size_t kWords>
+  BitField(const WideUint<kWords>& words)
+      : BitField(std::make_shared<Buffer>(kWords * 8)) {
+    Store(words);
+  }
+
   // Disallow copy constructor.
   BitField(const BitField&) = delete;
 
@@ -136,8 +273,28 @@ class BitField {
 
   ~BitField() = default;
 
-  // Returns a pointer to the underlying buffer.
-  std::shared_ptr<Buffer> buffer() const { return buffer_; }
+  // Returns the lowest bits of this field, right-aligned and zero-extended, as
+  // an unsigned integer of at most 64 bits, unsigned __int128 or WideUint.
+  template <typename T>
+  T Load() const;
+
+  // Stores an unsigned integer of at most 64 bits, unsigned __int128 or
+  // WideUint into this field, right-aligned and zero-extended. Unlike
+  // assignment, all bits of this field are written, and no buffer is allocated.
+  template <typename T>
+  void Store(const T& value);
+
+  // Returns a pointer to the underlying buffer for reading.
+  std::shared_ptr<const Buffer> buffer() const { return buffer_; }
+
+  // Returns a pointer to the underlying buffer for writing. CHECK-fails if the
+  // bit field is read-only.
+  std::shared_ptr<Buffer> mutable_buffer() {
+    return std::shared_ptr<Buffer>(buffer_, mutable_buffer_ptr());
+  }
+
+  // Returns whether the bit field may be written to.
+  bool writable() const { return writable_; }
 
   // Returns the offset (in bits).
   std::size_t offset() const { return offset_; }
@@ -146,11 +303,146 @@ class BitField {
   std::size_t width() const { return width_; }
 
  private:
-  std::shared_ptr<Buffer> buffer_ = nullptr;
+  Buffer* mutable_buffer_ptr() {
+    CHECK(writable_) << "BitField: read-only bit field";
+    return const_cast<Buffer*>(buffer_.get());
+  }
+
+  std::shared_ptr<const Buffer> buffer_ = nullptr;
   std::size_t offset_ = 0;
   std::size_t width_ = 0;
+  bool writable_ = true;
+};
+
+namespace buffer_internal {
+
+// Converts wide integers to and from words, with the most significant first.
+template <typename T>
+struct WideTraits;
+
+template <std::size_t kWords>
+struct WideTraits<WideUint<kWords>> {
+  static constexpr std::size_t kNumWords = kWords;
+
+  static void ToWords(const WideUint<kWords>& value, uint64_t* words) {
+    std::copy(value.begin(), value.end(), words);
+  }
+
+  static WideUint<kWords> FromWords(const uint64_t* words) {
+    WideUint<kWords> value;
+    std::copy(words, words + kWords, value.begin());
+    return value;
+  }
 };
 
+#ifdef ABSL_HAVE_INTRINSIC_INT128
+template <>
+struct WideTraits<unsigned __int128> {
+  static constexpr std::size_t kNumWords = 2;
+
+  static void ToWords(unsigned __int128 value, uint64_t* words) {
+    words[0] = static_cast<uint64_t>(value >> 64);
+    words[1] = static_cast<uint64_t>(value);
+  }
+
+  static unsigned __int128 FromWords(const uint64_t* words) {
+    return (static_cast<unsigned __int128>(words[0]) << 64) | words[1];
+  }
+};
+#endif
+
+// Hashes the width and count bits starting from offset (in bits), 64 bits at a
+// time.
+template <typename H>
+H HashBits(H h, const std::byte* data, std::size_t offset, std::size_t count) {
+  h = H::combine(std::move(h), count);
+  for (; count >= 64; offset += 64, count -= 64) {
+    h = H::combine(std::move(h), BitLoad(data, offset, 64));
+  }
+  if (count > 0) {
+    h = H::combine(std::move(h), BitLoad(data, offset, count));
+  }
+  return h;
+}
+
+}  // namespace buffer_internal
+
+template <typename T>
+T BitField::Load() const {
+  if (width_ == 0) {
+    return T{};
+  }
+  const std::byte* data = buffer_->data();
+  if constexpr (std::is_unsigned_v<T> && sizeof(T) <= 8) {
+    std::size_t count = std::min<std::size_t>(width_, 64);
+    return static_cast<T>(BitLoad(data, offset_ + width_ - count, count));
+  } else {
+    using Traits = buffer_internal::WideTraits<T>;
+    uint64_t words[Traits::kNumWords];
+    BitLoadWords(data, offset_, width_, words, Traits::kNumWords);
+    return Traits::FromWords(words);
+  }
+}
+
+template <typename T>
+void BitField::Store(const T& value) {
+  if (width_ == 0) {
+    return;
+  }
+  Buffer* buffer = mutable_buffer_ptr();
+  std::byte* data = buffer->data();
+  if constexpr (std::is_unsigned_v<T> && sizeof(T) <= 8) {
+    if (width_ <= 64) {
+      BitStore(data, offset_, width_, value);
+    } else {
+      uint64_t word = value;
+      BitStoreWords(data, offset_, width_, &word, 1);
+    }
+  } else {
+    using Traits = buffer_internal::WideTraits<T>;
+    uint64_t words[Traits::kNumWords];
+    Traits::ToWords(value, words);
+    BitStoreWords(data, offset_, width_, words, Traits::kNumWords);
+  }
+  buffer->MarkBitsDirty(offset_, width_);
+}
+
+// Compares the bits of two bit fields lexicographically, from the most
+// significant bit on. A bit field that is a prefix of another one is less.
+int Compare(const BitField& lhs, const BitField& rhs);
+
+// Bit fields are equal if they have the same width and bits, regardless of
+// their offsets and the bits around them.
+inline bool operator==(const BitField& lhs, const BitField& rhs) {
+  return lhs.width() == rhs.width() && Compare(lhs, rhs) == 0;
+}
+inline bool operator!=(const BitField& lhs, const BitField& rhs) {
+  return !(lhs == rhs);
+}
+inline bool operator<(const BitField& lhs, const BitField& rhs) {
+  return Compare(lhs, rhs) < 0;
+}
+inline bool operator>(const BitField& lhs, const BitField& rhs) {
+  return Compare(lhs, rhs) > 0;
+}
+inline bool operator<=(const BitField& lhs, const BitField& rhs) {
+  return Compare(lhs, rhs) <= 0;
+}
+inline bool operator>=(const BitField& lhs, const BitField& rhs) {
+  return Compare(lhs, rhs) >= 0;
+}
+
+// Hashes the width and bits of a bit field, 64 bits at a time, consistently
+// with operator==. Makes bit fields usable with absl::Hash.
+template <typename H>
+H AbslHashValue(H h, const BitField& field) {
+  if (field.width() == 0) {
+    return H::combine(std::move(h), field.width());
+  }
+  return buffer_internal::HashBits(std::move(h), field.buffer()->data(),
+                                   field.offset(), field.width());
+}
+
 }  // namespace p4buf
 
 #endif  // P4BUF_BUFFER_H_
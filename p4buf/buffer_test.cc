@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_format.h"
 
 namespace p4buf {
@@ -55,6 +56,30 @@ TEST(BufferTest, Buffer) {
   std::array<uint8_t, 4> bytes{0, 1, 2, 3};
   std::memcpy(b6.data(), bytes.data(), 4);
   EXPECT_TRUE(buf_eq(b6, {0, 1, 2, 3}));
+
+  // Copy a buffer.
+  Buffer b7(b6);
+  b6[0] = std::byte{4};
+  EXPECT_TRUE(buf_eq(b7, {0, 1, 2, 3}));
+
+  // Move a buffer.
+  Buffer b8(std::move(b7));
+  EXPECT_TRUE(buf_eq(b8, {0, 1, 2, 3}));
+  EXPECT_EQ(b7.size(), 0);
+  EXPECT_EQ(b7.data(), nullptr);
+
+  // Wrap external data, without copying it.
+  std::array<std::byte, 4> external{};
+  Buffer b9 = Buffer::Wrap(external.data(), external.size());
+  EXPECT_EQ(b9.data(), external.data());
+  EXPECT_FALSE(b9.owned());
+  b9[1] = std::byte{1};
+  EXPECT_EQ(external[1], std::byte{1});
+
+  // Copying a wrapping buffer copies the data.
+  Buffer b10(b9);
+  EXPECT_TRUE(b10.owned());
+  EXPECT_TRUE(buf_eq(b10, {0, 1, 0, 0}));
 }
 
 TEST(BufferTest, BitFieldCtor) {
@@ -256,4 +281,164 @@ TEST(BufferTest, BitFieldWriteUnalignedToUnaligned) {
   // //                          ^^^    ^^^^ ^^^^    ^^
 }
 
+TEST(BufferTest, BitFieldWriteOverlapping) {
+  // Shift bit fields forward and backward within one buffer, and compare with
+  // copying through another buffer.
+  for (std::size_t src_offset : {0, 3, 8, 13}) {
+    for (std::size_t dest_offset : {0, 1, 5, 8, 16, 21}) {
+      for (std::size_t width : {1, 7, 8, 30, 64, 65, 150}) {
+        Buffer init(32);
+        for (std::size_t i = 0; i < init.size(); ++i) {
+          init[i] = std::byte(i * 37 + 11);
+        }
+        auto buffer = std::make_shared<Buffer>(init);
+        auto expected = std::make_shared<Buffer>(init);
+        auto copy = std::make_shared<Buffer>(init);
+
+        BitField(buffer, dest_offset, width) =
+            BitField(buffer, src_offset, width);
+        BitField(expected, dest_offset, width) =
+            BitField(copy, src_offset, width);
+        EXPECT_TRUE(BitField(buffer, 0, 256) == BitField(expected, 0, 256))
+            << absl::StrFormat(
+                   "src_offset=%d dest_offset=%d width=%d", src_offset,
+                   dest_offset, width);
+      }
+    }
+  }
+}
+
+TEST(BufferTest, BitMemMoveDisjoint) {
+  // Disjoint ranges take the word-wide path, checked against BitMemCpy.
+  for (std::size_t src_offset : {0, 3, 8, 13}) {
+    for (std::size_t dest_offset : {0, 1, 5, 8, 16, 21}) {
+      for (std::size_t width : {1, 7, 8, 30, 64, 65, 150}) {
+        Buffer src(32);
+        Buffer got(32, 0x5a);
+        Buffer want(32, 0x5a);
+        for (std::size_t i = 0; i < src.size(); ++i) {
+          src[i] = std::byte(i * 37 + 11);
+        }
+        BitMemMove(got.data(), src.data(), dest_offset, src_offset, width);
+        BitMemCpy(want.data(), src.data(), dest_offset, src_offset, width);
+        EXPECT_TRUE(buf_eq(got, want)) << absl::StrFormat(
+            "src_offset=%d dest_offset=%d width=%d", src_offset, dest_offset,
+            width);
+      }
+    }
+  }
+}
+
+TEST(BufferTest, BitFieldCompare) {
+  // The same 70 bits at different offsets, with different bits around.
+  auto buffer1 = std::make_shared<Buffer>(16, 0x00);
+  auto buffer2 = std::make_shared<Buffer>(16, 0xff);
+  BitField bf1(buffer1, 3, 70);
+  BitField bf2(buffer2, 13, 70);
+  bf1 = BitField({0x0a, 0x1b, 0x2c, 0x3d, 0x4e, 0x5f, 0x6a, 0x7b, 0x8c, 0x9d});
+  bf2 = bf1;
+  EXPECT_TRUE(bf1 == bf2);
+  EXPECT_EQ(Compare(bf1, bf2), 0);
+  EXPECT_EQ(absl::Hash<BitField>()(bf1), absl::Hash<BitField>()(bf2));
+
+  // Differ in the last bit.
+  BitField(buffer2, 82, 1) = uint8_t{0};
+  EXPECT_TRUE(bf1 != bf2);
+  EXPECT_TRUE(bf2 < bf1);
+  EXPECT_TRUE(bf1 > bf2);
+  EXPECT_TRUE(bf2 <= bf1);
+  EXPECT_TRUE(bf1 >= bf2);
+
+  // Differ in width only: the prefix is less.
+  BitField prefix(buffer1, 3, 69);
+  EXPECT_TRUE(prefix != bf1);
+  EXPECT_TRUE(prefix < bf1);
+
+  // Aligned fields.
+  EXPECT_TRUE(BitField(uint32_t{0x01020304}) < BitField(uint32_t{0x01020305}));
+  EXPECT_TRUE(BitField(uint16_t{0x0102}) == BitField({0x01, 0x02}));
+  EXPECT_TRUE(BitField(uint8_t{0x02}) > BitField(uint16_t{0x0102}));
+  EXPECT_TRUE(BitField() == BitField());
+
+  // Usable as hash set keys.
+  absl::flat_hash_set<BitField> set;
+  set.insert(BitField(uint16_t{1}));
+  set.insert(BitField(uint16_t{1}));
+  set.insert(BitField(uint32_t{1}));
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_TRUE(set.contains(BitField({0x00, 0x01})));
+}
+
+TEST(BufferTest, BoundsCheck) {
+  static_assert(IsBoundsChecked(BoundsCheck::kAlways));
+  static_assert(!IsBoundsChecked(BoundsCheck::kNever));
+
+  auto buffer = std::make_shared<Buffer>(Buffer{0x01, 0x02});
+  EXPECT_EQ(buffer->at<BoundsCheck::kNever>(1), std::byte{0x02});
+  buffer->mutable_at<BoundsCheck::kNever>(0) = std::byte{0x03};
+  EXPECT_EQ(buffer->at(0), std::byte{0x03});
+  EXPECT_DEATH(buffer->at<BoundsCheck::kAlways>(2), "");
+  EXPECT_DEATH(buffer->mutable_at<BoundsCheck::kAlways>(2), "");
+
+  EXPECT_EQ(BitField::Make<BoundsCheck::kNever>(buffer, 4, 12).width(), 12);
+  EXPECT_DEATH(BitField::Make<BoundsCheck::kAlways>(buffer, 4, 13), "");
+}
+
+TEST(BufferTest, BitFieldReadOnly) {
+  std::shared_ptr<const Buffer> buffer =
+      std::make_shared<Buffer>(Buffer{0x01, 0x02});
+  BitField field = BitField::Make(buffer, 8, 8);
+  EXPECT_FALSE(field.writable());
+  EXPECT_EQ(field.Load<uint8_t>(), 0x02);
+  EXPECT_DEATH(field.Store(uint8_t{3}), "read-only");
+  EXPECT_DEATH(field = BitField(uint8_t{3}), "read-only");
+  EXPECT_DEATH(field.mutable_buffer(), "read-only");
+  EXPECT_EQ(buffer->at(1), std::byte{0x02});
+}
+
+TEST(BufferTest, BitFieldLoadAndStore) {
+  auto buffer = std::make_shared<Buffer>(32, 0xff);
+
+  // Narrow fields and values.
+  BitField bf12(buffer, 3, 12);
+  bf12.Store(uint16_t{0xabc});
+  EXPECT_EQ(bf12.Load<uint16_t>(), 0xabc);
+  EXPECT_EQ(bf12.Load<uint8_t>(), 0xbc);
+  EXPECT_EQ(bf12.Load<uint64_t>(), 0xabc);
+  bf12.Store(uint8_t{1});
+  EXPECT_EQ(bf12.Load<uint16_t>(), 1);
+  EXPECT_EQ(buffer->at(0), std::byte{0b1110'0000});
+  EXPECT_EQ(buffer->at(1), std::byte{0b0000'0011});
+
+  // Wide fields.
+  BitField bf150(buffer, 21, 150);
+  bf150.Store(uint64_t{0x0123456789abcdef});
+  EXPECT_EQ((bf150.Load<WideUint<3>>()),
+            (WideUint<3>{0, 0, 0x0123456789abcdef}));
+  bf150.Store(WideUint<3>{0xffffffffffffffff, 0x1111111111111111,
+                          0x2222222222222222});
+  EXPECT_EQ((bf150.Load<WideUint<3>>()),
+            (WideUint<3>{0x3fffff, 0x1111111111111111, 0x2222222222222222}));
+  EXPECT_EQ((bf150.Load<WideUint<1>>()), (WideUint<1>{0x2222222222222222}));
+  EXPECT_EQ(bf150.Load<uint32_t>(), 0x22222222);
+  EXPECT_TRUE(BitField(buffer, 171, 85) == BitField(buffer, 171, 85));
+  EXPECT_EQ(BitField(buffer, 171, 64).Load<uint64_t>(), ~uint64_t{0});
+
+  // Wide values into narrower fields.
+  bf12.Store(WideUint<2>{0xffff, 0xffff});
+  EXPECT_EQ(bf12.Load<uint16_t>(), 0xfff);
+  EXPECT_TRUE(BitField(WideUint<2>{1, 2}) ==
+              BitField({0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 2}));
+
+#ifdef ABSL_HAVE_INTRINSIC_INT128
+  BitField bf128(buffer, 5, 128);
+  unsigned __int128 value =
+      (static_cast<unsigned __int128>(0x20010db800000000) << 64) | 0x1;
+  bf128.Store(value);
+  EXPECT_TRUE(bf128.Load<unsigned __int128>() == value);
+  EXPECT_EQ((bf128.Load<WideUint<2>>()), (WideUint<2>{0x20010db800000000, 1}));
+  EXPECT_TRUE(BitField(value) == bf128);
+#endif
+}
+
 }  // namespace p4buf
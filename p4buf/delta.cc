@@ -0,0 +1,202 @@
+#include "p4buf/delta.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "absl/base/internal/endian.h"
+#include "absl/log/check.h"
+
+namespace p4buf {
+namespace {
+
+// Appends a LEB128 varint.
+void AppendVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// Reads a LEB128 varint at pos, advancing pos. Returns false if malformed or
+// wider than 64 bits.
+bool ReadVarint(const std::string& in, std::size_t& pos, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+    uint64_t byte = static_cast<uint8_t>(in[pos++]);
+    // The 10th byte only has room for the top bit, and can't continue.
+    if (shift == 63 && byte > 1) {
+      return false;
+    }
+    value |= (byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Appends the ranges that differ between two arrays of the given size to the
+// delta, at offsets shifted by base.
+void AppendDiff(BufferDelta& delta, const std::byte* old_data,
+                const std::byte* new_data, std::size_t size, std::size_t base) {
+  std::size_t offset = 0;
+  while (offset < size) {
+    // Skip equal words, then equal bytes.
+    while (offset + 8 <= size &&
+           std::memcmp(old_data + offset, new_data + offset, 8) == 0) {
+      offset += 8;
+    }
+    while (offset < size && old_data[offset] == new_data[offset]) {
+      ++offset;
+    }
+    if (offset == size) {
+      break;
+    }
+
+    // Extend the run until 8 bytes in a row are equal again, so that short
+    // equal gaps don't cost a range header each.
+    std::size_t end = offset + 1;
+    std::size_t equal = 0;
+    for (; end < size && equal < 8; ++end) {
+      equal = old_data[end] == new_data[end] ? equal + 1 : 0;
+    }
+    end -= equal;
+    delta.Append(base + offset, new_data + offset, end - offset);
+    offset = end;
+  }
+}
+
+}  // namespace
+
+BufferDelta::BufferDelta(std::string encoded) : encoded_(std::move(encoded)) {
+  // Find where the last range ends. A malformed encoding stays so.
+  ForEachRange(std::numeric_limits<std::size_t>::max(),
+               [this](std::size_t offset, const std::byte*, std::size_t count) {
+                 end_ = offset + count;
+               });
+}
+
+BufferDelta BufferDelta::FromDirty(const Buffer& buffer) {
+  CHECK(buffer.dirty_tracking());
+  BufferDelta delta;
+  buffer.ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    delta.Append(offset, buffer.data() + offset, count);
+  });
+  return delta;
+}
+
+BufferDelta BufferDelta::FromDirty(const P4Data& p4data) {
+  CHECK(p4data.buffer() != nullptr);
+  const Buffer& buffer = *p4data.buffer();
+  BufferDelta delta = FromDirty(buffer);
+  if (auto lengths = p4data.lengths()) {
+    delta.Append(buffer.size(), lengths->data(), lengths->size());
+  }
+  return delta;
+}
+
+BufferDelta BufferDelta::Diff(const Buffer& base, const Buffer& target) {
+  CHECK(base.size() == target.size());
+  BufferDelta delta;
+  AppendDiff(delta, base.data(), target.data(), target.size(), 0);
+  return delta;
+}
+
+BufferDelta BufferDelta::Diff(const P4Data& base, const P4Data& target) {
+  CHECK(base.buffer() != nullptr && target.buffer() != nullptr);
+  BufferDelta delta = Diff(*base.buffer(), *target.buffer());
+  if (auto lengths = target.lengths()) {
+    CHECK(base.lengths() != nullptr &&
+          base.lengths()->size() == lengths->size());
+    AppendDiff(delta, base.lengths()->data(), lengths->data(), lengths->size(),
+               target.buffer()->size());
+  }
+  return delta;
+}
+
+void BufferDelta::Append(std::size_t offset, const std::byte* data,
+                         std::size_t count) {
+  CHECK(offset >= end_);
+  AppendVarint(encoded_, offset - end_);
+  AppendVarint(encoded_, count);
+  encoded_.append(reinterpret_cast<const char*>(data), count);
+  end_ = offset + count;
+}
+
+template <typename Write>
+bool BufferDelta::ForEachRange(std::size_t size, Write write) const {
+  std::size_t pos = 0;
+  std::size_t offset = 0;
+  while (pos < encoded_.size()) {
+    uint64_t gap;
+    uint64_t count;
+    if (!ReadVarint(encoded_, pos, gap) || !ReadVarint(encoded_, pos, count)) {
+      return false;
+    }
+    if (gap > size - offset || count > size - offset - gap ||
+        count > encoded_.size() - pos) {
+      return false;
+    }
+    offset += gap;
+    write(offset, reinterpret_cast<const std::byte*>(encoded_.data() + pos),
+          count);
+    offset += count;
+    pos += count;
+  }
+  return true;
+}
+
+bool BufferDelta::Apply(Buffer& buffer) const {
+  return ForEachRange(
+      buffer.size(),
+      [&](std::size_t offset, const std::byte* data, std::size_t count) {
+        std::memcpy(buffer.data() + offset, data, count);
+        buffer.MarkDirty(offset, count);
+      });
+}
+
+bool BufferDelta::Apply(P4Data& p4data) const {
+  auto buffer = p4data.mutable_buffer();
+  const P4Layout& layout = *p4data.layout();
+  if (layout.num_varbits() == 0) {
+    return Apply(*buffer);
+  }
+
+  // Stage the lengths, so that they are only set once known to be valid.
+  const std::byte* old_lengths = p4data.lengths()->data();
+  std::vector<std::byte> lengths(old_lengths,
+                                 old_lengths + layout.lengths_size());
+  bool ok = ForEachRange(
+      buffer->size() + lengths.size(),
+      [&](std::size_t offset, const std::byte* data, std::size_t count) {
+        std::size_t size = buffer->size();
+        if (offset < size) {
+          std::size_t n = std::min(count, size - offset);
+          std::memcpy(buffer->data() + offset, data, n);
+          buffer->MarkDirty(offset, n);
+          offset += n;
+          data += n;
+          count -= n;
+        }
+        std::memcpy(lengths.data() + (offset - size), data, count);
+      });
+  if (!ok) {
+    return false;
+  }
+  for (std::size_t i = 0; i < layout.num_varbits(); ++i) {
+    uint32_t length = absl::little_endian::Load32(lengths.data() + i * 4);
+    if (length > layout.desc(layout.varbit_node(i)).width()) {
+      return false;
+    }
+  }
+  for (std::size_t i = 0; i < layout.num_varbits(); ++i) {
+    p4data.set_varbit_length(
+        i, absl::little_endian::Load32(lengths.data() + i * 4));
+  }
+  return true;
+}
+
+}  // namespace p4buf
@@ -0,0 +1,82 @@
+// Compact deltas between versions of a buffer.
+
+#ifndef P4BUF_DELTA_H_
+#define P4BUF_DELTA_H_
+
+#include <cstddef>
+#include <string>
+
+#include "p4buf/buffer.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// Buffer delta holds byte ranges changed from one version of a buffer to
+// another. It's encoded as a sequence of ranges in increasing offset order,
+// each being:
+//
+//   varint gap (from the end of the previous range)
+//   varint count
+//   count bytes of new data
+//
+// So the encoded size is proportional to the changes, not the buffer size.
+//
+// Deltas of P4 data with varbits also cover the varbit lengths, as if they
+// followed the buffer.
+class BufferDelta {
+ public:
+  // Creates an empty delta.
+  BufferDelta() = default;
+
+  // Creates a delta from its encoding, so that more ranges may be appended.
+  explicit BufferDelta(std::string encoded);
+
+  // Encodes the dirty ranges of the buffer, in time proportional to the number
+  // of dirty chunks. Dirty tracking must be enabled.
+  static BufferDelta FromDirty(const Buffer& buffer);
+
+  // Same as above, for the buffer of the P4 data, followed by all its varbit
+  // lengths.
+  static BufferDelta FromDirty(const P4Data& p4data);
+
+  // Encodes the ranges that differ between two buffers of the same size,
+  // comparing 8 bytes at a time.
+  static BufferDelta Diff(const Buffer& base, const Buffer& target);
+
+  // Same as above, for the buffers and varbit lengths of two P4 data of the
+  // same layout.
+  static BufferDelta Diff(const P4Data& base, const P4Data& target);
+
+  // Appends a range of new data. The offset must not be lower than the end of
+  // the previous range.
+  void Append(std::size_t offset, const std::byte* data, std::size_t count);
+
+  // Writes the new data into the buffer, and marks it dirty. Returns false
+  // (possibly after writing some ranges) if the delta is malformed or out of
+  // bounds.
+  bool Apply(Buffer& buffer) const;
+
+  // Same as above, for the buffer and varbit lengths of the P4 data, copying
+  // shared ones first. Lengths past the maximum of their varbit make the delta
+  // malformed, and are never set.
+  bool Apply(P4Data& p4data) const;
+
+  // Returns the encoding.
+  const std::string& encoded() const { return encoded_; }
+
+  bool empty() const { return encoded_.empty(); }
+
+ private:
+  // Decodes the ranges, and calls write(offset, data, count) for each. Returns
+  // false if the delta is malformed or goes past size.
+  template <typename Write>
+  bool ForEachRange(std::size_t size, Write write) const;
+
+  std::string encoded_;
+  // End offset of the last appended range.
+  std::size_t end_ = 0;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_DELTA_H_
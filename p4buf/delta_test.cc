@@ -0,0 +1,159 @@
+#include "p4buf/delta.h"
+
+#include <gtest/gtest.h>
+
+namespace p4buf {
+
+TEST(DeltaTest, DirtyTracking) {
+  Buffer buffer(100, 0);
+  buffer.EnableDirtyTracking(4);
+  EXPECT_TRUE(buffer.dirty_tracking());
+
+  buffer.mutable_at(1) = std::byte{1};
+  buffer.MarkDirty(6, 3);
+  buffer.MarkDirty(40, 1);
+  buffer.MarkBitsDirty(99 * 8 + 3, 2);
+
+  std::vector<std::tuple<std::size_t, std::size_t>> ranges;
+  buffer.ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    ranges.emplace_back(offset, count);
+  });
+  std::vector<std::tuple<std::size_t, std::size_t>> want = {
+      {0, 12}, {40, 4}, {96, 4}};
+  EXPECT_EQ(ranges, want);
+
+  buffer.ClearDirty();
+  ranges.clear();
+  buffer.ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    ranges.emplace_back(offset, count);
+  });
+  EXPECT_TRUE(ranges.empty());
+
+  // Reads aren't recorded.
+  EXPECT_EQ(buffer[1], std::byte{1});
+  EXPECT_EQ(buffer.at(40), std::byte{0});
+  buffer.ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    ranges.emplace_back(offset, count);
+  });
+  EXPECT_TRUE(ranges.empty());
+}
+
+TEST(DeltaTest, BitFieldWritesAreTracked) {
+  auto buffer = std::make_shared<Buffer>(16, 0);
+  buffer->EnableDirtyTracking();
+  BitField(buffer, 13, 6) = uint8_t{0x3f};
+
+  std::vector<std::tuple<std::size_t, std::size_t>> ranges;
+  buffer->ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    ranges.emplace_back(offset, count);
+  });
+  std::vector<std::tuple<std::size_t, std::size_t>> want = {{1, 2}};
+  EXPECT_EQ(ranges, want);
+}
+
+TEST(DeltaTest, DecodeThenAppend) {
+  std::byte bytes[2] = {std::byte{1}, std::byte{2}};
+  BufferDelta delta;
+  delta.Append(2, bytes, 2);
+
+  // Appending to a decoded delta continues from its last range.
+  BufferDelta decoded(delta.encoded());
+  decoded.Append(8, bytes, 1);
+  Buffer buffer(16, 0);
+  EXPECT_TRUE(decoded.Apply(buffer));
+  EXPECT_EQ(buffer.at(2), std::byte{1});
+  EXPECT_EQ(buffer.at(3), std::byte{2});
+  EXPECT_EQ(buffer.at(8), std::byte{1});
+  EXPECT_EQ(buffer.at(14), std::byte{0});
+  EXPECT_DEATH(decoded.Append(4, bytes, 1), "");
+}
+
+TEST(DeltaTest, FromDirtyAndApply) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4TupleT{
+      P4BitT{32},
+      P4BitT{4096},
+      P4BitT{32},
+  }));
+  P4Data p4data(layout, 0);
+  P4Data replica(layout, 0);
+
+  p4data.mutable_buffer()->EnableDirtyTracking(8);
+  p4data["/0"] = uint32_t{0x01020304};
+  p4data["/2"] = uint32_t{0x05060708};
+
+  auto delta = BufferDelta::FromDirty(p4data);
+  EXPECT_LT(delta.encoded().size(), 32);
+  EXPECT_TRUE(delta.Apply(replica));
+  EXPECT_EQ(std::memcmp(replica.buffer()->data(), p4data.buffer()->data(),
+                        layout->byte_size()),
+            0);
+}
+
+TEST(DeltaTest, VarbitLengths) {
+  auto layout = P4Layout::Intern(P4Type(P4StructT{
+      {"a", P4BitT{8}},
+      {"options", P4VarbitT{32}},
+  }));
+  P4Data base(layout, 0);
+  P4Data target = base.Clone();
+  target["options"] = BitField({0xab, 0xcd});
+
+  auto delta = BufferDelta::Diff(base, target);
+  EXPECT_TRUE(delta.Apply(base));
+  EXPECT_TRUE(base == target);
+  EXPECT_EQ(base["options"].length(), 16);
+
+  // Lengths are always sent whole by FromDirty.
+  target.mutable_buffer()->EnableDirtyTracking(8);
+  target["options"].set_length(8);
+  EXPECT_TRUE(BufferDelta::FromDirty(target).Apply(base));
+  EXPECT_EQ(base["options"].length(), 8);
+
+  // Past the maximum.
+  BufferDelta malformed;
+  std::byte length[4] = {std::byte{33}};
+  malformed.Append(layout->byte_size(), length, 4);
+  EXPECT_FALSE(malformed.Apply(base));
+  EXPECT_EQ(base["options"].length(), 8);
+}
+
+TEST(DeltaTest, DiffAndApply) {
+  Buffer base(1000, 0);
+  Buffer target(base);
+  target[3] = std::byte{1};
+  target[5] = std::byte{2};
+  target[500] = std::byte{3};
+  target[999] = std::byte{4};
+
+  auto delta = BufferDelta::Diff(base, target);
+  EXPECT_LT(delta.encoded().size(), 20);
+  EXPECT_TRUE(delta.Apply(base));
+  EXPECT_EQ(std::memcmp(base.data(), target.data(), base.size()), 0);
+
+  // An identical buffer gives an empty delta.
+  EXPECT_TRUE(BufferDelta::Diff(base, target).empty());
+}
+
+TEST(DeltaTest, ApplyRejectsMalformedDelta) {
+  Buffer buffer(4, 0);
+
+  // Out of bounds.
+  BufferDelta delta;
+  std::byte bytes[2] = {std::byte{1}, std::byte{2}};
+  delta.Append(3, bytes, 2);
+  EXPECT_FALSE(delta.Apply(buffer));
+
+  // Truncated.
+  EXPECT_FALSE(BufferDelta(std::string("\x00\x05\x01", 3)).Apply(buffer));
+  EXPECT_FALSE(BufferDelta(std::string("\x80", 1)).Apply(buffer));
+
+  // Varints wider than 64 bits, whose high bits would otherwise be lost and
+  // leave a gap of 0.
+  std::string overflow = std::string(9, '\x80') + "\x02\x01\x07";
+  EXPECT_FALSE(BufferDelta(overflow).Apply(buffer));
+  std::string overlong = std::string(10, '\x80') + "\x01\x01\x07";
+  EXPECT_FALSE(BufferDelta(overlong).Apply(buffer));
+  EXPECT_EQ(buffer.at(0), std::byte{0});
+}
+
+}  // namespace p4buf
@@ -0,0 +1,187 @@
+#include "p4buf/executor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "absl/log/check.h"
+
+namespace p4buf {
+
+void* ScratchArena::Allocate(std::size_t size, std::size_t alignment) {
+  while (true) {
+    if (block_index_ < blocks_.size()) {
+      auto& block = blocks_[block_index_];
+      auto base = reinterpret_cast<std::uintptr_t>(block.data.get());
+      std::size_t begin =
+          (base + used_ + alignment - 1) / alignment * alignment;
+      if (begin + size <= base + block.size) {
+        used_ = begin + size - base;
+        return reinterpret_cast<void*>(begin);
+      }
+      // Move on to the next block, unless this one is still empty.
+      if (used_ > 0) {
+        ++block_index_;
+        used_ = 0;
+        continue;
+      }
+    }
+    // No block fits, so add one big enough.
+    std::size_t block_size = std::max(block_size_, size + alignment);
+    blocks_.insert(blocks_.begin() + block_index_,
+                   {std::unique_ptr<std::byte[]>(new std::byte[block_size]),
+                    block_size});
+    used_ = 0;
+  }
+}
+
+ParallelExecutor::ParallelExecutor(std::size_t num_threads,
+                                   std::size_t chunk_size)
+    : chunk_size_(chunk_size) {
+  CHECK(chunk_size_ > 0);
+  num_threads = std::max<std::size_t>(num_threads, 1);
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  // Worker 0 is the calling thread.
+  for (std::size_t i = 1; i < num_threads; ++i) {
+    threads_.emplace_back(&ParallelExecutor::ThreadLoop, this, i);
+  }
+}
+
+ParallelExecutor::~ParallelExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ParallelExecutor::Run(P4DataBatch& batch, const Stage& stage) {
+  ParallelFor(batch.size(), [&batch, &stage](std::size_t begin,
+                                             std::size_t end,
+                                             ScratchArena& arena) {
+    for (std::size_t i = begin; i < end; ++i) {
+      stage(batch[i], i, arena);
+    }
+  });
+}
+
+void ParallelExecutor::ParallelFor(std::size_t size, const Body& body) {
+  if (size == 0) {
+    return;
+  }
+
+  // Give each worker an even share of consecutive chunks, for locality.
+  std::size_t num_chunks = (size + chunk_size_ - 1) / chunk_size_;
+  std::size_t num_workers = workers_.size();
+  for (std::size_t w = 0; w < num_workers; ++w) {
+    std::lock_guard<std::mutex> lock(workers_[w]->mutex);
+    for (std::size_t c = num_chunks * w / num_workers;
+         c < num_chunks * (w + 1) / num_workers; ++c) {
+      workers_[w]->chunks.emplace_back(c * chunk_size_,
+                                       std::min(size, (c + 1) * chunk_size_));
+    }
+  }
+
+  // Wake up background threads, and work along with them.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    body_ = &body;
+    ++generation_;
+    num_running_ = threads_.size();
+  }
+  start_cv_.notify_all();
+  Work(0, body);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this]() { return num_running_ == 0; });
+  body_ = nullptr;
+  if (exception_ != nullptr) {
+    std::rethrow_exception(std::exchange(exception_, nullptr));
+  }
+}
+
+void ParallelExecutor::Work(std::size_t worker, const Body& body) {
+  auto& arena = workers_[worker]->arena;
+  std::tuple<std::size_t, std::size_t> chunk;
+  while (TakeChunk(worker, chunk)) {
+    arena.Reset();
+    try {
+      body(std::get<0>(chunk), std::get<1>(chunk), arena);
+    } catch (...) {
+      Abort();
+    }
+  }
+}
+
+void ParallelExecutor::Abort() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (exception_ == nullptr) {
+      exception_ = std::current_exception();
+    }
+  }
+  for (auto& worker : workers_) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->chunks.clear();
+  }
+}
+
+bool ParallelExecutor::TakeChunk(std::size_t worker,
+                                 std::tuple<std::size_t, std::size_t>& chunk) {
+  {
+    auto& own = *workers_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.chunks.empty()) {
+      chunk = own.chunks.front();
+      own.chunks.pop_front();
+      return true;
+    }
+  }
+
+  // Steal from the others, starting from the next one. Thieves take the
+  // chunks farthest from where the owner is working.
+  for (std::size_t i = 1; i < workers_.size(); ++i) {
+    auto& victim = *workers_[(worker + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.chunks.empty()) {
+      chunk = victim.chunks.back();
+      victim.chunks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParallelExecutor::ThreadLoop(std::size_t worker) {
+  uint64_t generation = 0;
+  while (true) {
+    const Body* body;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_cv_.wait(lock, [this, generation]() {
+        return stopping_ || generation_ != generation;
+      });
+      if (stopping_) {
+        return;
+      }
+      generation = generation_;
+      body = body_;
+    }
+
+    Work(worker, *body);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--num_running_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+}
+
+}  // namespace p4buf
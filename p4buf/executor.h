@@ -0,0 +1,143 @@
+// Multi-core execution of stages over batches of P4 data.
+
+#ifndef P4BUF_EXECUTOR_H_
+#define P4BUF_EXECUTOR_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "p4buf/batch.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// Scratch arena is a bump allocator for per-thread temporary data. Memory is
+// reclaimed all at once by Reset(), and blocks are kept for reuse.
+class ScratchArena {
+ public:
+  explicit ScratchArena(std::size_t block_size = 64 * 1024)
+      : block_size_(block_size) {}
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  // Returns uninitialized memory of the given size and alignment, valid until
+  // the next Reset().
+  void* Allocate(std::size_t size,
+                 std::size_t alignment = alignof(std::max_align_t));
+
+  // Reclaims all allocated memory.
+  void Reset() {
+    block_index_ = 0;
+    used_ = 0;
+  }
+
+ private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    std::size_t size;
+  };
+
+  std::size_t block_size_;
+  std::vector<Block> blocks_;
+  // Current block, and bytes used in it.
+  std::size_t block_index_ = 0;
+  std::size_t used_ = 0;
+};
+
+// Parallel executor runs a stage over batches of P4 data with a pool of
+// threads, including the calling one.
+//
+// A batch is split into chunks of consecutive records. Each thread starts with
+// an even share of the chunks, and steals from others once it runs out. Every
+// record is processed exactly once, and the stage is told its index, so results
+// written by index come out in a deterministic order.
+class ParallelExecutor {
+ public:
+  // Stage to run on a record, given its index in the batch and the scratch
+  // arena of the running thread. The arena is reset between chunks.
+  //
+  // For light stages, looking fields up by path and assigning values through
+  // temporary bit fields cost far more than the call itself. Hot stages should
+  // access fields by position, and write with Store().
+  using Stage =
+      std::function<void(P4Data& record, std::size_t index, ScratchArena&)>;
+
+  // Body to run on a range of indices [begin, end).
+  using Body =
+      std::function<void(std::size_t begin, std::size_t end, ScratchArena&)>;
+
+  // Creates an executor with the given number of threads (including the
+  // calling one), splitting batches into chunks of the given size.
+  explicit ParallelExecutor(
+      std::size_t num_threads = std::thread::hardware_concurrency(),
+      std::size_t chunk_size = 64);
+
+  ParallelExecutor(const ParallelExecutor&) = delete;
+  ParallelExecutor& operator=(const ParallelExecutor&) = delete;
+
+  ~ParallelExecutor();
+
+  // Runs the stage on every record of the batch, and returns when all are
+  // done. If the stage throws, the remaining chunks are skipped, and the first
+  // exception is rethrown here once all threads are done.
+  void Run(P4DataBatch& batch, const Stage& stage);
+
+  // Runs the body on chunks covering [0, size), and returns when all are done.
+  // Exceptions thrown by the body are handled as in Run().
+  void ParallelFor(std::size_t size, const Body& body);
+
+  std::size_t num_threads() const { return workers_.size(); }
+
+  std::size_t chunk_size() const { return chunk_size_; }
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::tuple<std::size_t, std::size_t>> chunks;
+    ScratchArena arena;
+  };
+
+  // Runs chunks as the given worker until none is left anywhere.
+  void Work(std::size_t worker, const Body& body);
+
+  // Records the exception being handled, if it's the first one of the job, and
+  // drops all queued chunks.
+  void Abort();
+
+  // Takes a chunk from the front of the worker's own queue, so that it walks
+  // its share in order, or from the back of another one's. Returns false if all
+  // queues are empty.
+  bool TakeChunk(std::size_t worker,
+                 std::tuple<std::size_t, std::size_t>& chunk);
+
+  // Main loop of background threads.
+  void ThreadLoop(std::size_t worker);
+
+  std::size_t chunk_size_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+
+  // Job hand-off to background threads.
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const Body* body_ = nullptr;
+  uint64_t generation_ = 0;
+  std::size_t num_running_ = 0;
+  bool stopping_ = false;
+  // The first exception thrown by the current job.
+  std::exception_ptr exception_ = nullptr;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_EXECUTOR_H_
@@ -0,0 +1,113 @@
+#include "p4buf/executor.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace p4buf {
+
+TEST(ExecutorTest, ScratchArena) {
+  ScratchArena arena(64);
+  auto* a = static_cast<std::byte*>(arena.Allocate(16));
+  auto* b = static_cast<std::byte*>(arena.Allocate(16));
+  EXPECT_GE(b, a + 16);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(arena.Allocate(8, 32)) % 32, 0);
+
+  // Larger than a block.
+  EXPECT_NE(arena.Allocate(1000), nullptr);
+
+  // Memory is reused after reset.
+  arena.Reset();
+  EXPECT_EQ(arena.Allocate(16), a);
+}
+
+TEST(ExecutorTest, ParallelForCoversEachIndexOnce) {
+  ParallelExecutor executor(4, 10);
+  EXPECT_EQ(executor.num_threads(), 4);
+
+  for (std::size_t size : {0, 1, 9, 10, 11, 1000}) {
+    std::vector<std::atomic<int>> counts(size);
+    executor.ParallelFor(size, [&counts](std::size_t begin, std::size_t end,
+                                         ScratchArena&) {
+      EXPECT_LE(end - begin, 10);
+      for (std::size_t i = begin; i < end; ++i) {
+        ++counts[i];
+      }
+    });
+    for (std::size_t i = 0; i < size; ++i) {
+      EXPECT_EQ(counts[i], 1);
+    }
+  }
+}
+
+TEST(ExecutorTest, RunIsDeterministic) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"a", P4BitT{32}},
+      {"b", P4BitT{32}},
+  }));
+  P4DataBatch batch(layout, 5000, 0);
+  EXPECT_EQ(batch.size(), 5000);
+
+  ParallelExecutor executor(8, 16);
+  std::vector<uint64_t> results(batch.size());
+  executor.Run(batch, [&results](P4Data& record, std::size_t index,
+                                 ScratchArena& arena) {
+    auto* scratch = static_cast<uint32_t*>(arena.Allocate(sizeof(uint32_t)));
+    *scratch = index * 3;
+    record["a"] = uint32_t{*scratch};
+    results[index] = index * 3;
+  });
+
+  for (std::size_t i = 0; i < batch.size(); ++i) {
+    EXPECT_EQ(results[i], i * 3);
+    const auto& buffer = *batch[i].buffer();
+    uint32_t a = (std::to_integer<uint32_t>(buffer.at(0)) << 24) |
+                 (std::to_integer<uint32_t>(buffer.at(1)) << 16) |
+                 (std::to_integer<uint32_t>(buffer.at(2)) << 8) |
+                 std::to_integer<uint32_t>(buffer.at(3));
+    EXPECT_EQ(a, i * 3);
+  }
+}
+
+TEST(ExecutorTest, SingleThread) {
+  ParallelExecutor executor(1);
+  std::vector<std::size_t> order;
+  executor.ParallelFor(200, [&order](std::size_t begin, std::size_t end,
+                                     ScratchArena&) {
+    for (std::size_t i = begin; i < end; ++i) {
+      order.push_back(i);
+    }
+  });
+  // A lone worker walks its chunks in order.
+  EXPECT_EQ(order.size(), 200);
+  EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+}
+
+TEST(ExecutorTest, ExceptionsReachTheCaller) {
+  ParallelExecutor executor(4, 10);
+  for (std::size_t bad : {0, 555, 999}) {
+    std::atomic<int> count = 0;
+    EXPECT_THROW(
+        executor.ParallelFor(1000,
+                             [&count, bad](std::size_t begin, std::size_t end,
+                                           ScratchArena&) {
+                               if (begin <= bad && bad < end) {
+                                 throw std::runtime_error("bad record");
+                               }
+                               count += end - begin;
+                             }),
+        std::runtime_error);
+    EXPECT_LT(count, 1000);
+  }
+
+  // The executor is still usable.
+  std::atomic<int> count = 0;
+  executor.ParallelFor(1000, [&count](std::size_t begin, std::size_t end,
+                                      ScratchArena&) { count += end - begin; });
+  EXPECT_EQ(count, 1000);
+}
+
+}  // namespace p4buf
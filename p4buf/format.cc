@@ -0,0 +1,327 @@
+#include "p4buf/format.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <string>
+
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+#include "p4buf/bit.h"
+
+namespace p4buf {
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+// Maps chars to hex digit values, or -1 for non-digits.
+constexpr std::array<int8_t, 256> MakeHexValues() {
+  std::array<int8_t, 256> values{};
+  for (int c = 0; c < 256; ++c) {
+    values[c] = c >= '0' && c <= '9'   ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                       : -1;
+  }
+  return values;
+}
+
+constexpr std::array<int8_t, 256> kHexValues = MakeHexValues();
+
+// Returns the number of hex digits written for a field of the given width.
+std::size_t NumHexDigits(std::size_t width) {
+  return std::max<std::size_t>((width + 3) / 4, 1);
+}
+
+// Returns the number of decimal digits of the value.
+std::size_t NumDecimalDigits(uint64_t value) {
+  char digits[20];
+  return std::to_chars(digits, digits + sizeof(digits), value).ptr - digits;
+}
+
+// Writes the field as hex digits, with leading zeros, 64 bits at a time from
+// the least significant end. Returns the end of the digits.
+char* WriteHex(char* out, const std::byte* data, std::size_t offset,
+               std::size_t width) {
+  char* end = out + NumHexDigits(width);
+  char* p = end;
+  if (width == 0) {
+    *--p = '0';
+  }
+  for (std::size_t remaining = width; remaining > 0;) {
+    std::size_t bits = std::min<std::size_t>(remaining, 64);
+    remaining -= bits;
+    uint64_t value = BitLoad(data, offset + remaining, bits);
+    for (std::size_t i = (bits + 3) / 4; i > 0; --i) {
+      *--p = kHexDigits[value & 0xf];
+      value >>= 4;
+    }
+  }
+  return end;
+}
+
+// Sets count bits starting from offset (in bits) to 0.
+void ClearBits(std::byte* data, std::size_t offset, std::size_t count) {
+  for (; count >= 64; offset += 64, count -= 64) {
+    BitStore(data, offset, 64, 0);
+  }
+  BitStore(data, offset, count, 0);
+}
+
+// Stores hex digits into the field. Returns false if they are malformed or too
+// wide for the field.
+bool ParseHex(absl::string_view digits, std::byte* data, std::size_t offset,
+              std::size_t width) {
+  if (digits.empty()) {
+    return false;
+  }
+
+  // Fast path: the value fits in a word.
+  if (digits.size() <= 16 && width <= 64) {
+    uint64_t value = 0;
+    for (char c : digits) {
+      int digit = kHexValues[static_cast<uint8_t>(c)];
+      if (digit < 0) {
+        return false;
+      }
+      value = (value << 4) | digit;
+    }
+    if (width < 64 && (value >> width) != 0) {
+      return false;
+    }
+    BitStore(data, offset, width, value);
+    return true;
+  }
+
+  for (char c : digits) {
+    if (kHexValues[static_cast<uint8_t>(c)] < 0) {
+      return false;
+    }
+  }
+
+  // Check the significant bits against the width.
+  std::size_t leading = digits.find_first_not_of('0');
+  if (leading == absl::string_view::npos) {
+    ClearBits(data, offset, width);
+    return true;
+  }
+  digits.remove_prefix(leading);
+  std::size_t num_bits = digits.size() * 4 - 4;
+  for (int value = kHexValues[static_cast<uint8_t>(digits[0])]; value > 0;
+       value >>= 1) {
+    ++num_bits;
+  }
+  if (num_bits > width) {
+    return false;
+  }
+
+  // Store 16 digits at a time from the least significant end.
+  ClearBits(data, offset, width - num_bits);
+  std::size_t stored = 0;
+  while (!digits.empty()) {
+    std::size_t n = std::min<std::size_t>(digits.size(), 16);
+    uint64_t value = 0;
+    for (char c : digits.substr(digits.size() - n)) {
+      value = (value << 4) | kHexValues[static_cast<uint8_t>(c)];
+    }
+    std::size_t bits = std::min(n * 4, num_bits - stored);
+    stored += bits;
+    BitStore(data, offset + width - stored, bits, value);
+    digits.remove_suffix(n);
+  }
+  return true;
+}
+
+// Stores decimal digits into the field. Returns false if they are malformed or
+// too wide for the field. Values wider than 64 bits have to be in hex.
+bool ParseDecimal(absl::string_view digits, std::byte* data,
+                  std::size_t offset, std::size_t width) {
+  uint64_t value = 0;
+  auto [ptr, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), value);
+  if (ec != std::errc() || ptr != digits.data() + digits.size() ||
+      digits.empty()) {
+    return false;
+  }
+  if (width < 64 && (value >> width) != 0) {
+    return false;
+  }
+
+  std::size_t bits = std::min<std::size_t>(width, 64);
+  ClearBits(data, offset, width - bits);
+  BitStore(data, offset + width - bits, bits, value);
+  return true;
+}
+
+}  // namespace
+
+P4DataFormatter::P4DataFormatter(const P4Layout& layout, Radix radix)
+    : radix_(radix), byte_size_(layout.byte_size()) {
+  std::string path;
+  AddFields(layout, P4Layout::kRoot, path);
+
+  // Index the paths once prefixes_ no longer moves.
+  for (std::size_t i = 0; i < fields_.size(); ++i) {
+    const auto& field = fields_[i];
+    index_.emplace(absl::string_view(prefixes_).substr(field.prefix_begin,
+                                                       field.prefix_size - 1),
+                   i);
+    max_size_ += field.prefix_size + max_value_size(field);
+  }
+  // Separators.
+  if (!fields_.empty()) {
+    max_size_ += fields_.size() - 1;
+  }
+}
+
+void P4DataFormatter::AddFields(const P4Layout& layout, std::size_t node,
+                                std::string& path) {
+  if (layout.is_field(node)) {
+    const auto& desc = layout.desc(node);
+    Field field;
+    field.offset = desc.offset();
+    field.width = desc.width();
+    field.varbit = layout.is_varbit(node) ? layout.varbit_index(node)
+                                          : Field::kNoVarbit;
+    field.prefix_begin = prefixes_.size();
+    absl::StrAppend(&prefixes_, path.empty() ? "/" : path, "=");
+    field.prefix_size = prefixes_.size() - field.prefix_begin;
+    fields_.push_back(field);
+    return;
+  }
+
+  std::size_t path_size = path.size();
+  for (std::size_t i = 0; i < layout.num_members(node); ++i) {
+    std::size_t member = layout.Member(node, i);
+    absl::string_view name = layout.name(member);
+    if (name.empty()) {
+      absl::StrAppend(&path, "/", i);
+    } else {
+      absl::StrAppend(&path, "/", name);
+    }
+    AddFields(layout, member, path);
+    path.resize(path_size);
+  }
+}
+
+std::size_t P4DataFormatter::max_value_size(const Field& field) const {
+  if (field.varbit == Field::kNoVarbit) {
+    return max_value_size(field.width);
+  }
+  // The length prefix, and a value that may be longer in decimal up to 64 bits
+  // than in hex at the maximum length.
+  return NumDecimalDigits(field.width) + 1 +
+         std::max(max_value_size(field.width),
+                  max_value_size(std::min<std::size_t>(field.width, 64)));
+}
+
+std::size_t P4DataFormatter::max_value_size(std::size_t width) const {
+  if (radix_ == Radix::kDecimal && width <= 64) {
+    return NumDecimalDigits(width == 64 ? ~uint64_t{0}
+                                        : (uint64_t{1} << width) - 1);
+  }
+  return 2 + NumHexDigits(width);
+}
+
+std::size_t P4DataFormatter::Format(const P4Data& p4data,
+                                    absl::Span<char> out) const {
+  CHECK(out.size() >= max_size_);
+  CHECK(p4data.buffer() != nullptr && p4data.buffer()->size() >= byte_size_);
+  const std::byte* data = p4data.buffer()->data();
+
+  char* p = out.data();
+  for (const auto& field : fields_) {
+    if (p != out.data()) {
+      *p++ = ' ';
+    }
+    std::memcpy(p, prefixes_.data() + field.prefix_begin, field.prefix_size);
+    p += field.prefix_size;
+    std::size_t width = field.width;
+    if (field.varbit != Field::kNoVarbit) {
+      width = p4data.varbit_length(field.varbit);
+      p = std::to_chars(p, out.data() + out.size(), width).ptr;
+      *p++ = 'w';
+    }
+    if (radix_ == Radix::kDecimal && width <= 64) {
+      p = std::to_chars(p, out.data() + out.size(),
+                        BitLoad(data, field.offset, width))
+              .ptr;
+    } else {
+      *p++ = '0';
+      *p++ = 'x';
+      p = WriteHex(p, data, field.offset, width);
+    }
+  }
+  return p - out.data();
+}
+
+std::string P4DataFormatter::Format(const P4Data& p4data) const {
+  std::string text(max_size_, '\0');
+  text.resize(Format(p4data, absl::MakeSpan(text)));
+  return text;
+}
+
+bool P4DataFormatter::Parse(absl::string_view text, P4Data& p4data) const {
+  auto buffer = p4data.mutable_buffer();
+  CHECK(buffer->size() >= byte_size_);
+  std::byte* data = buffer->data();
+
+  std::size_t next = 0;
+  while (!text.empty()) {
+    std::size_t end = std::min(text.find(' '), text.size());
+    absl::string_view pair = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+    if (pair.empty()) {
+      continue;
+    }
+
+    // Expect the next field in wire order, and look up the path otherwise.
+    std::size_t index;
+    if (next < fields_.size() &&
+        absl::string_view(prefixes_).substr(fields_[next].prefix_begin,
+                                            fields_[next].prefix_size) ==
+            pair.substr(0, fields_[next].prefix_size)) {
+      index = next;
+    } else {
+      std::size_t eq = pair.find('=');
+      if (eq == absl::string_view::npos) {
+        return false;
+      }
+      auto it = index_.find(pair.substr(0, eq));
+      if (it == index_.end()) {
+        return false;
+      }
+      index = it->second;
+    }
+    next = index + 1;
+
+    const auto& field = fields_[index];
+    absl::string_view value = pair.substr(field.prefix_size);
+    std::size_t width = field.width;
+    if (field.varbit != Field::kNoVarbit) {
+      // The length comes first, as a width prefix.
+      std::size_t w = std::min(value.find('w'), value.size());
+      auto [ptr, ec] = std::from_chars(value.data(), value.data() + w, width);
+      if (ec != std::errc() || ptr != value.data() + w || w == value.size() ||
+          width > field.width) {
+        return false;
+      }
+      value.remove_prefix(w + 1);
+    }
+    bool ok = value.size() >= 2 && value[0] == '0' &&
+                      (value[1] == 'x' || value[1] == 'X')
+                  ? ParseHex(value.substr(2), data, field.offset, width)
+                  : ParseDecimal(value, data, field.offset, width);
+    if (!ok) {
+      return false;
+    }
+    if (field.varbit != Field::kNoVarbit) {
+      p4data.set_varbit_length(field.varbit, width);
+    }
+    buffer->MarkBitsDirty(field.offset, width);
+  }
+  return true;
+}
+
+}  // namespace p4buf
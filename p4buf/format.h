@@ -0,0 +1,92 @@
+// Text formatting and parsing of P4 data.
+
+#ifndef P4BUF_FORMAT_H_
+#define P4BUF_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// P4DataFormatter writes the leaf fields of P4 data as space-separated
+// "path=value" pairs in wire order, and parses them back. For example:
+//
+//   /a=0x1 /b=0x1 /s/c=0x1 /s/d=0x1 /t/0=0x01 /t/1=0x01
+//
+// Paths are the ones accepted by P4Data::operator[], with tuple members
+// numbered. Hex values have a fixed number of digits for the field width.
+// Decimal values have no leading zeros, and fields wider than 64 bits are
+// still written in hex. Varbits have their current length as a P4 width prefix,
+// and only the bits up to it, like "/options=12w0xabc".
+//
+// The paths are compiled once per layout, so that formatting is a run of
+// memcpy, std::to_chars and digit table lookups into a caller buffer, without
+// any allocation.
+class P4DataFormatter {
+ public:
+  enum class Radix { kHex, kDecimal };
+
+  explicit P4DataFormatter(const P4Layout& layout, Radix radix = Radix::kHex);
+
+  // Writes the fields of the given P4 data, which must have a buffer of the
+  // layout, into out. Returns the number of chars written. out must hold at
+  // least max_size() chars.
+  std::size_t Format(const P4Data& p4data, absl::Span<char> out) const;
+
+  // Same as above, but returns a string.
+  std::string Format(const P4Data& p4data) const;
+
+  // Parses "path=value" pairs into the given P4 data of the layout, allocating
+  // its buffer (or copying a shared one) if needed. Values may be hex with a
+  // "0x" prefix or decimal, regardless of the radix. Pairs may come in any
+  // order, though wire order is the fastest. Fields not in the text are left
+  // intact. Returns false if the text is malformed, names an unknown path or
+  // has a value too wide for its field, with pairs before that applied.
+  bool Parse(absl::string_view text, P4Data& p4data) const;
+
+  // Returns the maximum number of chars written by Format.
+  std::size_t max_size() const { return max_size_; }
+
+  Radix radix() const { return radix_; }
+
+ private:
+  struct Field {
+    static constexpr uint32_t kNoVarbit = ~uint32_t{0};
+
+    uint32_t offset;  // In bits.
+    uint32_t width;   // The maximum for a varbit.
+    // Varbit index, or kNoVarbit.
+    uint32_t varbit;
+    // The "path=" prefix, in prefixes_.
+    uint32_t prefix_begin;
+    uint32_t prefix_size;
+  };
+
+  void AddFields(const P4Layout& layout, std::size_t node, std::string& path);
+
+  // Returns the maximum number of chars of a field value.
+  std::size_t max_value_size(const Field& field) const;
+
+  // Same as above, for a value of the given width.
+  std::size_t max_value_size(std::size_t width) const;
+
+  Radix radix_;
+  std::size_t byte_size_;
+  std::size_t max_size_ = 0;
+  std::vector<Field> fields_;
+  // All "path=" prefixes concatenated.
+  std::string prefixes_;
+  // Field indices by path, for pairs out of wire order.
+  absl::flat_hash_map<absl::string_view, std::size_t> index_;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_FORMAT_H_
@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "p4buf/format.h"
+
+namespace p4buf {
+namespace {
+
+// An IPv4-like header.
+std::shared_ptr<const P4Layout> HeaderLayout() {
+  return std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"version", P4BitT{4}},
+      {"ihl", P4BitT{4}},
+      {"diffserv", P4BitT{8}},
+      {"total_len", P4BitT{16}},
+      {"identification", P4BitT{16}},
+      {"flags", P4BitT{3}},
+      {"frag_offset", P4BitT{13}},
+      {"ttl", P4BitT{8}},
+      {"protocol", P4BitT{8}},
+      {"hdr_checksum", P4BitT{16}},
+      {"src_addr", P4BitT{32}},
+      {"dst_addr", P4BitT{32}},
+  }));
+}
+
+void BM_Format(benchmark::State& state) {
+  P4Data p4data(HeaderLayout(), 0x5a);
+  auto radix = static_cast<P4DataFormatter::Radix>(state.range(0));
+  P4DataFormatter formatter(*p4data.layout(), radix);
+  std::vector<char> out(formatter.max_size());
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(formatter.Format(p4data, absl::MakeSpan(out)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Format)->Arg(0)->Arg(1);
+
+void BM_Parse(benchmark::State& state) {
+  P4Data p4data(HeaderLayout(), 0x5a);
+  auto radix = static_cast<P4DataFormatter::Radix>(state.range(0));
+  P4DataFormatter formatter(*p4data.layout(), radix);
+  std::string text = formatter.Format(p4data);
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(formatter.Parse(text, p4data));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Parse)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace p4buf
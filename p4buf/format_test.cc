@@ -0,0 +1,150 @@
+#include "p4buf/format.h"
+
+#include <gtest/gtest.h>
+
+namespace p4buf {
+namespace {
+
+P4Type ExampleType() {
+  return P4Type(P4StructT{
+      {"a", P4BitT{1}},
+      {"b", P4BitT{2}},
+      {"s",
+       P4StructT{
+           {"c", P4BitT{3}},
+           {"d", P4BitT{4}},
+       }},
+      {"t",
+       P4TupleT{
+           P4BitT{5},
+           P4BitT{6},
+       }},
+      {"w", P4BitT{72}},
+  });
+}
+
+}  // namespace
+
+TEST(P4DataFormatterTest, Format) {
+  P4Data p4data(ExampleType(), 0);
+  p4data["/a"] = uint8_t{1};
+  p4data["/b"] = uint8_t{2};
+  p4data["/s/c"] = uint8_t{5};
+  p4data["/s/d"] = uint8_t{15};
+  p4data["/t/0"] = uint8_t{17};
+  p4data["/t/1"] = uint8_t{63};
+  p4data["/w"] =
+      BitField({0xab, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef});
+
+  P4DataFormatter hex(*p4data.layout());
+  EXPECT_EQ(hex.Format(p4data),
+            "/a=0x1 /b=0x2 /s/c=0x5 /s/d=0xf /t/0=0x11 /t/1=0x3f "
+            "/w=0xab0123456789abcdef");
+  EXPECT_EQ(hex.Format(p4data).size(), hex.max_size());
+
+  P4DataFormatter decimal(*p4data.layout(), P4DataFormatter::Radix::kDecimal);
+  EXPECT_EQ(decimal.Format(p4data),
+            "/a=1 /b=2 /s/c=5 /s/d=15 /t/0=17 /t/1=63 "
+            "/w=0xab0123456789abcdef");
+
+  // Into a caller buffer.
+  std::vector<char> out(decimal.max_size());
+  std::size_t size = decimal.Format(p4data, absl::MakeSpan(out));
+  EXPECT_EQ(absl::string_view(out.data(), size), decimal.Format(p4data));
+
+  // A bare field.
+  P4Data bare(P4Type(P4BitT{12}), 0);
+  bare[""] = uint16_t{0xabc};
+  EXPECT_EQ(P4DataFormatter(*bare.layout()).Format(bare), "/=0xabc");
+}
+
+TEST(P4DataFormatterTest, Parse) {
+  P4Data p4data(ExampleType(), 0xff);
+  P4DataFormatter formatter(*p4data.layout());
+
+  P4Data parsed(p4data.layout(), 0);
+  ASSERT_TRUE(formatter.Parse(formatter.Format(p4data), parsed));
+  EXPECT_TRUE(parsed == p4data);
+
+  // Out of order, in decimal, and with leading zeros.
+  ASSERT_TRUE(formatter.Parse(
+      "/t/1=0x0001 /s/c=2 /w=0x00000000000000000000000000000300 /a=0", parsed));
+  EXPECT_EQ(formatter.Format(parsed),
+            "/a=0x0 /b=0x3 /s/c=0x2 /s/d=0xf /t/0=0x1f /t/1=0x01 "
+            "/w=0x000000000000000300");
+
+  // Decimal into a wide field.
+  ASSERT_TRUE(formatter.Parse("/w=18446744073709551615", parsed));
+  std::string text = formatter.Format(parsed);
+  EXPECT_EQ(text.substr(text.rfind(' ') + 1), "/w=0x00ffffffffffffffff");
+
+  // Bad input.
+  EXPECT_FALSE(formatter.Parse("/x=0x1", parsed));
+  EXPECT_FALSE(formatter.Parse("/s=0x1", parsed));
+  EXPECT_FALSE(formatter.Parse("/a", parsed));
+  EXPECT_FALSE(formatter.Parse("/a=", parsed));
+  EXPECT_FALSE(formatter.Parse("/a=0x", parsed));
+  EXPECT_FALSE(formatter.Parse("/a=0xg", parsed));
+  EXPECT_FALSE(formatter.Parse("/a=-1", parsed));
+  EXPECT_FALSE(formatter.Parse("/a=0x2", parsed));
+  EXPECT_FALSE(formatter.Parse("/b=4", parsed));
+  EXPECT_FALSE(formatter.Parse("/w=0x1000000000000000000", parsed));
+  EXPECT_TRUE(formatter.Parse("/w=0x0ff0000000000000000", parsed));
+}
+
+TEST(P4DataFormatterTest, Varbit) {
+  P4Data p4data(P4Type(P4StructT{
+                    {"a", P4BitT{4}},
+                    {"options", P4VarbitT{80}},
+                    {"b", P4BitT{4}},
+                }),
+                0xff);
+  p4data["options"] =
+      BitField(std::make_shared<Buffer>(Buffer{0xab, 0xc0}), 0, 12);
+  P4DataFormatter hex(*p4data.layout());
+  // Only the bits up to the length, which leads as a width prefix.
+  EXPECT_EQ(hex.Format(p4data), "/a=0xf /options=12w0xabc /b=0xf");
+  P4DataFormatter decimal(*p4data.layout(), P4DataFormatter::Radix::kDecimal);
+  EXPECT_EQ(decimal.Format(p4data), "/a=15 /options=12w2748 /b=15");
+
+  // The longest values fit in max_size().
+  p4data["options"] =
+      BitField({0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff});
+  EXPECT_EQ(hex.Format(p4data).size(), hex.max_size());
+  EXPECT_EQ(decimal.Format(p4data).size(), decimal.max_size());
+  p4data["options"] =
+      BitField({0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff});
+  EXPECT_LE(decimal.Format(p4data).size(), decimal.max_size());
+
+  // Parsing sets the length.
+  P4Data parsed(p4data.layout(), 0);
+  ASSERT_TRUE(hex.Parse("/options=12w0xabc", parsed));
+  EXPECT_EQ(parsed["options"].length(), 12);
+  EXPECT_EQ(parsed["options"].Load<uint16_t>(), 0xabc);
+  ASSERT_TRUE(hex.Parse("/options=0w0", parsed));
+  EXPECT_EQ(parsed["options"].length(), 0);
+  ASSERT_TRUE(hex.Parse(decimal.Format(p4data), parsed));
+  EXPECT_TRUE(parsed == p4data);
+
+  EXPECT_FALSE(hex.Parse("/options=0xabc", parsed));
+  EXPECT_FALSE(hex.Parse("/options=w0xabc", parsed));
+  EXPECT_FALSE(hex.Parse("/options=81w0x0", parsed));
+  EXPECT_FALSE(hex.Parse("/options=8w0xabc", parsed));
+}
+
+TEST(P4DataFormatterTest, ParseMarksDirty) {
+  P4Data p4data(ExampleType(), 0);
+  p4data.mutable_buffer()->EnableDirtyTracking();
+  P4DataFormatter formatter(*p4data.layout());
+
+  ASSERT_TRUE(formatter.Parse("/w=0x1", p4data));
+  std::vector<std::pair<std::size_t, std::size_t>> ranges;
+  p4data.buffer()->ForEachDirtyRange(
+      [&](std::size_t offset, std::size_t count) {
+        ranges.emplace_back(offset, count);
+      });
+  EXPECT_EQ(ranges,
+            (std::vector<std::pair<std::size_t, std::size_t>>{{2, 10}}));
+}
+
+}  // namespace p4buf
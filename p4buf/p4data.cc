@@ -1,6 +1,32 @@
 #include "p4buf/p4data.h"
 
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+#include "absl/base/internal/endian.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/log/check.h"
+#include "p4buf/bit.h"
+
 namespace p4buf {
+namespace {
+
+// Compares two bit ranges lexicographically, like BitField.
+int CompareBits(const std::byte* lhs, std::size_t lhs_offset,
+                std::size_t lhs_width, const std::byte* rhs,
+                std::size_t rhs_offset, std::size_t rhs_width) {
+  std::size_t width = std::min(lhs_width, rhs_width);
+  if (width > 0) {
+    int result = BitMemCmp(lhs, lhs_offset, rhs, rhs_offset, width);
+    if (result != 0) {
+      return result;
+    }
+  }
+  return lhs_width < rhs_width ? -1 : lhs_width > rhs_width ? 1 : 0;
+}
+
+}  // namespace
 
 P4StructT::P4StructT(
     std::initializer_list<std::tuple<std::string, P4TypeVariant>> members) {
@@ -26,12 +52,28 @@ P4TupleT::P4TupleT(std::initializer_list<P4TypeVariant> members) {
   }
 }
 
+bool operator==(const P4StructT& lhs, const P4StructT& rhs) {
+  if (lhs.member_names_ != rhs.member_names_) {
+    return false;
+  }
+  for (const auto& name : lhs.member_names_) {
+    if (lhs.members_.at(name) != rhs.members_.at(name)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void P4TupleT::Traverse(Visitor visit) const {
   for (std::size_t i = 0; i < members_.size(); ++i) {
     visit(i, members_.at(i));
   }
 }
 
+bool operator==(const P4TupleT& lhs, const P4TupleT& rhs) {
+  return lhs.members_ == rhs.members_;
+}
+
 const P4Type& P4Type::operator[](absl::string_view name) const {
   return (*std::get<Box<P4StructT>>(variant_))[name];
 }
@@ -44,65 +86,390 @@ std::size_t P4Type::bitwidth() const {
   std::size_t bitwidth;
   std::visit(
       Overloaded{
-          [&bitwidth](P4BitT p4type) { bitwidth = p4type.bitwidth(); },
-          [&bitwidth](Box<P4StructT> p4type) { bitwidth = p4type->bitwidth(); },
-          [&bitwidth](Box<P4TupleT> p4type) { bitwidth = p4type->bitwidth(); },
+          [&bitwidth](const P4BitT& p4type) { bitwidth = p4type.bitwidth(); },
+          [&bitwidth](const P4VarbitT& p4type) {
+            bitwidth = p4type.bitwidth();
+          },
+          [&bitwidth](const Box<P4StructT>& p4type) {
+            bitwidth = p4type->bitwidth();
+          },
+          [&bitwidth](const Box<P4TupleT>& p4type) {
+            bitwidth = p4type->bitwidth();
+          },
       },
       variant_);
   return bitwidth;
 }
 
-P4Data::P4Data(const P4Type& type, std::optional<uint8_t> init_val)
-    : type_(type) {
-  std::string prefix = "";
-  std::size_t offset = 0;
+FieldDesc::FieldDesc(std::size_t offset, std::size_t width)
+    : offset_(offset), width_(width) {
+  CHECK(offset_ == offset && width_ == width);
+}
+
+P4Layout::P4Layout(const P4Type& type)
+    : type_(type), type_hash_(absl::Hash<P4Type>()(type_)) {
+  AddNode(type_, 0, "");
+  CHECK(names_.size() == static_cast<uint32_t>(names_.size()));
+}
+
+std::shared_ptr<const P4Layout> P4Layout::Intern(const P4Type& type) {
+  // Layouts are held weakly, so that they go away with their last P4 data.
+  // Entries of expired layouts are swept once the map has doubled since the
+  // last sweep, which keeps inserts amortized constant time.
+  static auto* mutex = new std::mutex;
+  static auto* layouts =
+      new absl::node_hash_map<P4Type, std::weak_ptr<const P4Layout>>;
+  static std::size_t sweep_size = 64;
+
+  std::lock_guard<std::mutex> lock(*mutex);
+  auto [it, inserted] = layouts->try_emplace(type);
+  auto shared = it->second.lock();
+  if (shared != nullptr) {
+    return shared;
+  }
+  shared = std::make_shared<const P4Layout>(type);
+  it->second = shared;
+  if (inserted && layouts->size() > sweep_size) {
+    absl::erase_if(*layouts, [](const auto& entry) {
+      return entry.second.expired();
+    });
+    sweep_size = std::max<std::size_t>(64, layouts->size() * 2);
+  }
+  return shared;
+}
+
+std::size_t P4Layout::AddNode(const P4Type& type, std::size_t offset,
+                              absl::string_view name) {
+  std::size_t node = nodes_.size();
+  nodes_.push_back({FieldDesc(offset, type.bitwidth()), &type,
+                    static_cast<uint32_t>(names_.size()),
+                    static_cast<uint32_t>(name.size()), 0, 0});
+  names_.append(name.data(), name.size());
+
+  // Collect members first, so that they take a contiguous member table range.
+  std::vector<std::tuple<absl::string_view, const P4Type*>> members;
+  std::visit(Overloaded{
+                 [&](const P4BitT&) { field_nodes_.push_back(node); },
+                 [&](const P4VarbitT&) {
+                   field_nodes_.push_back(node);
+                   varbit_nodes_.push_back(node);
+                 },
+                 [&](const Box<P4StructT>& struct_t) {
+                   struct_t->Traverse(
+                       [&](absl::string_view name, const P4Type& p4type) {
+                         members.emplace_back(name, &p4type);
+                       });
+                 },
+                 [&](const Box<P4TupleT>& tuple_t) {
+                   tuple_t->Traverse([&](std::size_t, const P4Type& p4type) {
+                     members.emplace_back("", &p4type);
+                   });
+                 },
+             },
+             type.variant());
+
+  std::size_t begin = members_.size();
+  nodes_[node].members_begin = begin;
+  nodes_[node].num_members = members.size();
+  members_.resize(begin + members.size());
+  for (std::size_t i = 0; i < members.size(); ++i) {
+    const auto& [member_name, member_type] = members[i];
+    members_[begin + i] = AddNode(*member_type, offset, member_name);
+    offset += member_type->bitwidth();
+  }
+
+  // Sort struct members by name. Tuple members are looked up by index.
+  auto members_begin = members_.begin() + begin;
+  auto members_end = members_begin + members.size();
+  sorted_members_.resize(members_.size());
+  auto sorted_begin = sorted_members_.begin() + begin;
+  std::copy(members_begin, members_end, sorted_begin);
+  std::sort(sorted_begin, sorted_begin + members.size(),
+            [this](uint32_t a, uint32_t b) {
+              return this->name(a) < this->name(b);
+            });
+
+  return node;
+}
+
+std::optional<std::size_t> P4Layout::Find(absl::string_view path) const {
+  auto node = FindNode(kRoot, path);
+  if (!node.has_value() || !is_field(*node)) {
+    return std::nullopt;
+  }
+  return std::lower_bound(field_nodes_.begin(), field_nodes_.end(), *node) -
+         field_nodes_.begin();
+}
+
+std::optional<std::size_t> P4Layout::FindNode(std::size_t node,
+                                              absl::string_view path) const {
+  if (!path.empty() && path.front() == '/') {
+    path.remove_prefix(1);
+  }
+  if (path.empty()) {
+    return node;
+  }
+
+  while (true) {
+    auto pos = path.find('/');
+    auto segment = path.substr(0, pos);
+    const auto& parent = nodes_.at(node);
+
+    if (std::holds_alternative<Box<P4StructT>>(parent.type->variant())) {
+      auto begin = sorted_members_.begin() + parent.members_begin;
+      auto end = begin + parent.num_members;
+      auto it = std::lower_bound(
+          begin, end, segment,
+          [this](uint32_t member, absl::string_view segment) {
+            return name(member) < segment;
+          });
+      if (it == end || name(*it) != segment) {
+        return std::nullopt;
+      }
+      node = *it;
+    } else {
+      // Parse a tuple index.
+      std::size_t index = 0;
+      // One spelling per index: no sign, and no leading zeros.
+      if (segment.empty() || segment.size() > 9 ||
+          (segment.size() > 1 && segment.front() == '0')) {
+        return std::nullopt;
+      }
+      for (char c : segment) {
+        if (c < '0' || c > '9') {
+          return std::nullopt;
+        }
+        index = index * 10 + (c - '0');
+      }
+      if (index >= parent.num_members) {
+        return std::nullopt;
+      }
+      node = members_[parent.members_begin + index];
+    }
+
+    if (pos == absl::string_view::npos) {
+      return node;
+    }
+    path.remove_prefix(pos + 1);
+  }
+}
+
+std::size_t P4Layout::Resolve(std::size_t node, absl::string_view path) const {
+  auto result = FindNode(node, path);
+  if (!result.has_value()) {
+    throw std::out_of_range("P4Layout::Resolve: no such node");
+  }
+  return *result;
+}
+
+std::size_t P4Layout::Member(std::size_t node, absl::string_view name) const {
+  if (name.find('/') != absl::string_view::npos) {
+    throw std::out_of_range("P4Layout::Member: not a member name");
+  }
+  return Resolve(node, name);
+}
+
+std::size_t P4Layout::varbit_index(std::size_t node) const {
+  auto it = std::lower_bound(varbit_nodes_.begin(), varbit_nodes_.end(), node);
+  if (it == varbit_nodes_.end() || *it != node) {
+    throw std::out_of_range("P4Layout::varbit_index: not a varbit");
+  }
+  return it - varbit_nodes_.begin();
+}
+
+std::pair<std::size_t, std::size_t> P4Layout::varbit_range(
+    std::size_t node) const {
+  // Nodes are numbered in pre-order, so the node's subtree ends right after its
+  // last descendant.
+  std::size_t last = node;
+  while (num_members(last) > 0) {
+    last = Member(last, num_members(last) - 1);
+  }
+  auto begin =
+      std::lower_bound(varbit_nodes_.begin(), varbit_nodes_.end(), node);
+  auto end = std::upper_bound(begin, varbit_nodes_.end(), last);
+  return {begin - varbit_nodes_.begin(), end - varbit_nodes_.begin()};
+}
+
+absl::string_view P4Layout::name(std::size_t node) const {
+  const auto& n = nodes_.at(node);
+  return absl::string_view(names_).substr(n.name_begin, n.name_size);
+}
+
+P4DataView& P4DataView::operator=(const P4DataView& other) {
+  *this = other.field();
+  if (layout_->is_field(node_)) {
+    return *this;
+  }
+
+  auto [begin, end] = layout_->varbit_range(node_);
+  if (begin == end || type() != other.type()) {
+    return *this;
+  }
+  std::size_t other_begin = other.layout_->varbit_range(other.node_).first;
+  for (std::size_t i = begin; i < end; ++i) {
+    mutable_p4data_->set_varbit_length(
+        i, other.p4data_->varbit_length(other_begin + i - begin));
+  }
+  return *this;
+}
+
+P4DataView& P4DataView::operator=(const BitField& other) {
+  if (!layout_->is_varbit(node_)) {
+    mutable_field() = other;
+    return *this;
+  }
+
+  // Bits past the length are left alone, as they may be packet payload.
+  CHECK(other.width() <= width());
+  CHECK(mutable_p4data_ != nullptr) << "P4DataView: read-only view";
+  auto buffer = mutable_p4data_->mutable_buffer();
+  if (other.width() > 0) {
+    BitMemMove(buffer->data(), other.buffer()->data(), offset(),
+               other.offset(), other.width());
+    buffer->MarkBitsDirty(offset(), other.width());
+  }
+  mutable_p4data_->set_varbit_length(layout_->varbit_index(node_),
+                                     other.width());
+  return *this;
+}
 
-  // Visit type nodes recursively to flatten type.
-  std::function<void(absl::string_view, const P4Type&)> visit;
-  visit = [&](absl::string_view name, const P4Type& p4type) -> void {
-    std::visit(Overloaded{
-                   [&](P4BitT bit_t) {
-                     field_spec_[prefix + std::string{name}] = {
-                         offset, bit_t.bitwidth()};
-                     offset += bit_t.bitwidth();
-                   },
-                   [&](Box<P4StructT> struct_t) {
-                     std::string prefix_backup = prefix;
-                     prefix += (std::string{name} + "/");
-                     struct_t->Traverse(visit);
-                     prefix = prefix_backup;
-                   },
-                   [&](Box<P4TupleT> tuple_t) {
-                     std::string prefix_backup = prefix;
-                     prefix += (std::string{name} + "/");
-                     tuple_t->Traverse(
-                         [&](std::size_t index, const P4Type& p4type) -> void {
-                           visit(std::to_string(index), p4type);
-                         });
-                     prefix = prefix_backup;
-                   },
-               },
-               p4type.variant());
-  };
-
-  visit("", type);
+void P4DataView::set_length(std::size_t length) {
+  CHECK(mutable_p4data_ != nullptr) << "P4DataView: read-only view";
+  mutable_p4data_->set_varbit_length(layout_->varbit_index(node_), length);
+}
+
+P4Data::P4Data(const P4Type& type, std::optional<uint8_t> init_val)
+    : P4Data(P4Layout::Intern(type), init_val) {}
 
+P4Data::P4Data(std::shared_ptr<const P4Layout> layout,
+               std::optional<uint8_t> init_val)
+    : layout_(std::move(layout)) {
   if (init_val.has_value()) {
     NewBuffer(init_val);
   }
 }
 
-BitField P4Data::operator[](absl::string_view path) {
-  const auto& [offset, width] = field_spec_.at(path);
+P4Data::P4Data(const P4Data& other)
+    : layout_(other.layout_),
+      buffer_(other.buffer_),
+      lengths_(other.lengths_) {
+  if (buffer_ != nullptr) {
+    shared_.store(true, std::memory_order_relaxed);
+    other.shared_.store(true, std::memory_order_relaxed);
+  }
+}
+
+P4Data& P4Data::operator=(const P4Data& other) {
+  if (this != &other) {
+    *this = P4Data(other);
+  }
+  return *this;
+}
+
+P4Data::P4Data(P4Data&& other) noexcept
+    : layout_(std::move(other.layout_)),
+      buffer_(std::move(other.buffer_)),
+      lengths_(std::move(other.lengths_)),
+      shared_(other.shared_.load(std::memory_order_relaxed)) {}
+
+P4Data& P4Data::operator=(P4Data&& other) noexcept {
+  layout_ = std::move(other.layout_);
+  buffer_ = std::move(other.buffer_);
+  lengths_ = std::move(other.lengths_);
+  shared_.store(other.shared_.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+  return *this;
+}
+
+P4Data P4Data::Wrap(std::shared_ptr<const P4Layout> layout,
+                    std::shared_ptr<Buffer> buffer,
+                    std::shared_ptr<Buffer> lengths) {
+  CHECK(buffer != nullptr && buffer->size() >= layout->byte_size());
+  if (layout->num_varbits() == 0) {
+    lengths = nullptr;
+  } else if (lengths == nullptr) {
+    lengths = std::make_shared<Buffer>(layout->lengths_size(), 0);
+  } else {
+    CHECK(lengths->size() >= layout->lengths_size());
+  }
+  P4Data p4data(std::move(layout));
+  p4data.buffer_ = std::move(buffer);
+  p4data.lengths_ = std::move(lengths);
+  return p4data;
+}
+
+void P4Data::NewBuffer(std::optional<uint8_t> init_val) {
+  buffer_ = std::make_shared<Buffer>(layout_->byte_size(), init_val);
+  lengths_ = layout_->num_varbits() == 0
+                 ? nullptr
+                 : std::make_shared<Buffer>(layout_->lengths_size(), 0);
+  shared_.store(false, std::memory_order_relaxed);
+}
+
+std::shared_ptr<Buffer> P4Data::mutable_buffer() {
   if (buffer_ == nullptr) {
     NewBuffer();
+  } else if (shared_.load(std::memory_order_relaxed)) {
+    // Copy the buffers if other clones still hold them. Holders of wrapped
+    // data can't be counted, so it's copied as well.
+    if (buffer_.use_count() > 1 || !buffer_->owned()) {
+      buffer_ = std::make_shared<Buffer>(*buffer_);
+    }
+    if (lengths_ != nullptr &&
+        (lengths_.use_count() > 1 || !lengths_->owned())) {
+      lengths_ = std::make_shared<Buffer>(*lengths_);
+    }
+    shared_.store(false, std::memory_order_relaxed);
   }
-  return BitField(buffer_, offset, width);
+  return buffer_;
 }
 
-void P4Data::NewBuffer(std::optional<uint8_t> init_val) {
-  std::size_t size = (type_.bitwidth() + 7) / 8;
-  buffer_ = std::make_shared<Buffer>(size, init_val);
+std::shared_ptr<Buffer> P4Data::mutable_lengths() {
+  mutable_buffer();
+  return lengths_;
+}
+
+std::size_t P4Data::varbit_length(std::size_t index) const {
+  CHECK(lengths_ != nullptr && index < layout_->num_varbits());
+  return absl::little_endian::Load32(lengths_->data() + index * 4);
+}
+
+void P4Data::set_varbit_length(std::size_t index, std::size_t length) {
+  CHECK(length <= layout_->desc(layout_->varbit_node(index)).width());
+  auto lengths = mutable_lengths();
+  absl::little_endian::Store32(lengths->data() + index * 4, length);
+  lengths->MarkDirty(index * 4, 4);
+}
+
+int Compare(const P4Data& lhs, const P4Data& rhs) {
+  CHECK(lhs.buffer() != nullptr && rhs.buffer() != nullptr);
+  const std::byte* lhs_data = lhs.buffer()->data();
+  const std::byte* rhs_data = rhs.buffer()->data();
+  const P4Layout& layout = *lhs.layout();
+  if (layout.num_varbits() == 0 || !layout.SameType(*rhs.layout())) {
+    return CompareBits(lhs_data, 0, layout.bitwidth(), rhs_data, 0,
+                       rhs.layout()->bitwidth());
+  }
+
+  // Compare the fixed bits between varbits, and the varbits up to their
+  // lengths.
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < layout.num_varbits(); ++i) {
+    const auto& desc = layout.desc(layout.varbit_node(i));
+    std::size_t width = desc.offset() - offset;
+    int result = CompareBits(lhs_data, offset, width, rhs_data, offset, width);
+    if (result == 0) {
+      result = CompareBits(lhs_data, desc.offset(), lhs.varbit_length(i),
+                           rhs_data, desc.offset(), rhs.varbit_length(i));
+    }
+    if (result != 0) {
+      return result;
+    }
+    offset = desc.offset() + desc.width();
+  }
+  std::size_t width = layout.bitwidth() - offset;
+  return CompareBits(lhs_data, offset, width, rhs_data, offset, width);
 }
 
 }  // namespace p4buf
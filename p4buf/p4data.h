@@ -7,12 +7,21 @@
 #ifndef P4BUF_P4DATA_H_
 #define P4BUF_P4DATA_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/log/check.h"
 #include "absl/strings/string_view.h"
+#include "p4buf/bounds_check.h"
 #include "p4buf/buffer.h"
 #include "p4buf/utility.h"
 
@@ -20,13 +29,16 @@ namespace p4buf {
 
 // Core abstractions.
 class P4Type;
+class P4Layout;
 class P4Data;
 
 // Supported P4 types.
 class P4BitT;
+class P4VarbitT;
 class P4StructT;
 class P4TupleT;
-using P4TypeVariant = std::variant<P4BitT, Box<P4StructT>, Box<P4TupleT>>;
+using P4TypeVariant =
+    std::variant<P4BitT, P4VarbitT, Box<P4StructT>, Box<P4TupleT>>;
 
 // P4 bit type.
 class P4BitT {
@@ -38,10 +50,49 @@ class P4BitT {
 
   std::size_t bitwidth() const { return bitwidth_; }
 
+  friend bool operator==(const P4BitT& lhs, const P4BitT& rhs) {
+    return lhs.bitwidth_ == rhs.bitwidth_;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const P4BitT& bit_t) {
+    return H::combine(std::move(h), bit_t.bitwidth_);
+  }
+
  private:
   std::size_t bitwidth_ = 0;
 };
 
+// P4 varbit type, whose length (in bits) is only known at runtime, up to a
+// maximum, like IPv4 options.
+//
+// It takes max_bitwidth() bits, as on the wire, holding the value left-aligned.
+// The current length is held by each P4 data, outside the buffer.
+class P4VarbitT {
+ public:
+  P4VarbitT() = default;
+  P4VarbitT(const P4VarbitT&) = default;
+  P4VarbitT(P4VarbitT&&) = default;
+  P4VarbitT(size_t max_bitwidth) : max_bitwidth_(max_bitwidth) {}
+
+  std::size_t max_bitwidth() const { return max_bitwidth_; }
+
+  // Returns the width (in bits) taken, which is the maximum.
+  std::size_t bitwidth() const { return max_bitwidth_; }
+
+  friend bool operator==(const P4VarbitT& lhs, const P4VarbitT& rhs) {
+    return lhs.max_bitwidth_ == rhs.max_bitwidth_;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const P4VarbitT& varbit_t) {
+    return H::combine(std::move(h), varbit_t.max_bitwidth_);
+  }
+
+ private:
+  std::size_t max_bitwidth_ = 0;
+};
+
 // P4 struct type.
 class P4StructT {
  public:
@@ -62,6 +113,12 @@ class P4StructT {
 
   std::size_t bitwidth() const { return bitwidth_; }
 
+  // Struct types are equal if they have equal members in the same order.
+  friend bool operator==(const P4StructT& lhs, const P4StructT& rhs);
+
+  template <typename H>
+  friend H AbslHashValue(H h, const P4StructT& struct_t);
+
  private:
   std::size_t bitwidth_ = 0;
   std::vector<std::string> member_names_;
@@ -87,6 +144,11 @@ class P4TupleT {
 
   std::size_t bitwidth() const { return bitwidth_; }
 
+  friend bool operator==(const P4TupleT& lhs, const P4TupleT& rhs);
+
+  template <typename H>
+  friend H AbslHashValue(H h, const P4TupleT& tuple_t);
+
  private:
   std::size_t bitwidth_ = 0;
   std::vector<P4Type> members_;
@@ -108,31 +170,544 @@ class P4Type {
 
   const P4TypeVariant& variant() const { return variant_; }
 
+  // Types are equal if they have the same structure, member names included.
+  friend bool operator==(const P4Type& lhs, const P4Type& rhs) {
+    return lhs.variant_ == rhs.variant_;
+  }
+  friend bool operator!=(const P4Type& lhs, const P4Type& rhs) {
+    return !(lhs == rhs);
+  }
+
+  // Hashes the structure consistently with operator==, so that types can key
+  // absl hash containers.
+  template <typename H>
+  friend H AbslHashValue(H h, const P4Type& p4type) {
+    h = H::combine(std::move(h), p4type.variant_.index());
+    return std::visit(
+        [&h](const auto& alternative) {
+          return H::combine(std::move(h), alternative);
+        },
+        p4type.variant_);
+  }
+
  private:
   P4TypeVariant variant_;
 };
 
-class P4Data {
+template <typename H>
+H AbslHashValue(H h, const P4StructT& struct_t) {
+  for (const auto& name : struct_t.member_names_) {
+    h = H::combine(std::move(h), name, struct_t.members_.at(name));
+  }
+  return H::combine(std::move(h), struct_t.member_names_.size());
+}
+
+template <typename H>
+H AbslHashValue(H h, const P4TupleT& tuple_t) {
+  return H::combine(std::move(h), tuple_t.members_);
+}
+
+// Compact descriptor of a leaf field: offset and width (in bits) packed into
+// 8 bytes.
+class FieldDesc {
  public:
-  using FieldSpec =
-      std::tuple<std::size_t /* offset */, std::size_t /* width */>;
+  FieldDesc() = default;
+  FieldDesc(std::size_t offset, std::size_t width);
 
-  P4Data(const P4Type& type, std::optional<uint8_t> init_val = std::nullopt);
+  std::size_t offset() const { return offset_; }
 
-  BitField operator[](absl::string_view path);
+  std::size_t width() const { return width_; }
 
-  void NewBuffer(std::optional<uint8_t> init_val = std::nullopt);
+ private:
+  uint32_t offset_ = 0;
+  uint32_t width_ = 0;
+};
+
+static_assert(sizeof(FieldDesc) == 8);
+
+// P4 layout flattens a P4 type into field descriptors. It is meant to be
+// computed once per type and shared by all P4 data of the type.
+//
+// Every node of the type tree gets an index, with the root being kRoot. Each
+// aggregate node has a member table, so paths resolve one segment at a time
+// without building any string. Leaf nodes are also indexed as fields, in wire
+// order.
+class P4Layout {
+ public:
+  static constexpr std::size_t kRoot = 0;
+
+  explicit P4Layout(const P4Type& type);
+
+  // Returns the layout of the given type, shared with all P4 data of equal
+  // types that are still around. Thread-safe.
+  static std::shared_ptr<const P4Layout> Intern(const P4Type& type);
+
+  // Node indices point into the type tree, so a layout stays where it is.
+  P4Layout(const P4Layout&) = delete;
+  P4Layout& operator=(const P4Layout&) = delete;
+
+  // Accesses node descriptor by path, like "/s/c" or "/s". Throws
+  // std::out_of_range if there is no such node.
+  const FieldDesc& at(absl::string_view path) const {
+    return desc(Resolve(kRoot, path));
+  }
+
+  // Returns the wire order index of the field with the given path, if any.
+  std::optional<std::size_t> Find(absl::string_view path) const;
+
+  // Returns the node at the given path relative to the given node, if any. The
+  // path consists of member names or decimal tuple indices without leading
+  // zeros, separated by "/", with an optional leading "/".
+  std::optional<std::size_t> FindNode(std::size_t node,
+                                      absl::string_view path) const;
+
+  // Same as FindNode, but throws std::out_of_range if there is no such node.
+  std::size_t Resolve(std::size_t node, absl::string_view path) const;
+
+  // Returns the member node of a struct node by name, or of a tuple node by
+  // decimal index. Throws std::out_of_range if there is no such member.
+  std::size_t Member(std::size_t node, absl::string_view name) const;
+
+  // Returns the member node of a struct or tuple node by position. Throws
+  // std::out_of_range if there is no such member, and bounds are checked under
+  // the policy.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  std::size_t Member(std::size_t node, std::size_t index) const {
+    const auto& parent = CheckedAt<kCheck>(nodes_, node);
+    if (IsBoundsChecked(kCheck) && index >= parent.num_members) {
+      throw std::out_of_range("P4Layout::Member: no such member");
+    }
+    return members_[parent.members_begin + index];
+  }
+
+  // Returns the number of members of a node, or 0 for a leaf.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  std::size_t num_members(std::size_t node) const {
+    return CheckedAt<kCheck>(nodes_, node).num_members;
+  }
+
+  // Returns the member name of a node within its parent struct, or "" if the
+  // parent is not a struct.
+  absl::string_view name(std::size_t node) const;
+
+  // Accesses node descriptor by node index.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  const FieldDesc& desc(std::size_t node) const {
+    return CheckedAt<kCheck>(nodes_, node).desc;
+  }
+
+  // Accesses node type by node index.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  const P4Type& node_type(std::size_t node) const {
+    return *CheckedAt<kCheck>(nodes_, node).type;
+  }
+
+  // Returns whether the node is a leaf field, of a bit or varbit type.
+  bool is_field(std::size_t node) const {
+    const auto& variant = node_type(node).variant();
+    return std::holds_alternative<P4BitT>(variant) ||
+           std::holds_alternative<P4VarbitT>(variant);
+  }
+
+  // Returns whether the node is a leaf field of a varbit type.
+  bool is_varbit(std::size_t node) const {
+    return std::holds_alternative<P4VarbitT>(node_type(node).variant());
+  }
+
+  std::size_t num_nodes() const { return nodes_.size(); }
+
+  // Accesses field descriptor by wire order index.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  const FieldDesc& field(std::size_t index) const {
+    return desc<kCheck>(field_node<kCheck>(index));
+  }
+
+  // Returns the node index of the field at the given wire order index.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  std::size_t field_node(std::size_t index) const {
+    return CheckedAt<kCheck>(field_nodes_, index);
+  }
+
+  std::size_t num_fields() const { return field_nodes_.size(); }
+
+  // Returns the node index of the varbit at the given index, in wire order.
+  std::size_t varbit_node(std::size_t index) const {
+    return varbit_nodes_.at(index);
+  }
+
+  // Returns the index of the varbit at the given node, in wire order. Throws
+  // std::out_of_range if the node is not a varbit.
+  std::size_t varbit_index(std::size_t node) const;
+
+  std::size_t num_varbits() const { return varbit_nodes_.size(); }
+
+  // Returns the range [begin, end) of the indices of the varbits within the
+  // given node, itself included.
+  std::pair<std::size_t, std::size_t> varbit_range(std::size_t node) const;
+
+  // Returns the size (in bytes) of a buffer holding the current lengths of the
+  // varbits, as 32-bit little-endian words in wire order.
+  std::size_t lengths_size() const { return num_varbits() * 4; }
 
   const P4Type& type() const { return type_; }
 
-  std::shared_ptr<Buffer> buffer() const { return buffer_; }
+  // Returns absl::Hash of the type, computed once.
+  std::size_t type_hash() const { return type_hash_; }
+
+  // Returns whether the other layout is of an equal type. It's quick for the
+  // same layout, or different types.
+  bool SameType(const P4Layout& other) const {
+    return this == &other ||
+           (type_hash_ == other.type_hash_ && type_ == other.type_);
+  }
+
+  std::size_t bitwidth() const { return type_.bitwidth(); }
+
+  // Returns the size (in bytes) of a buffer holding the type.
+  std::size_t byte_size() const { return (bitwidth() + 7) / 8; }
 
  private:
+  struct Node {
+    FieldDesc desc;
+    const P4Type* type;
+    // Name within the parent struct, in names_.
+    uint32_t name_begin;
+    uint32_t name_size;
+    // Member table range, in members_ and sorted_members_.
+    uint32_t members_begin;
+    uint32_t num_members;
+  };
+
+  std::size_t AddNode(const P4Type& type, std::size_t offset,
+                      absl::string_view name);
+
   const P4Type type_;
-  absl::flat_hash_map<std::string, FieldSpec> field_spec_;
+  const std::size_t type_hash_;
+  std::vector<Node> nodes_;
+  // Member node indices, in declaration order.
+  std::vector<uint32_t> members_;
+  // Member node indices, sorted by name for struct nodes.
+  std::vector<uint32_t> sorted_members_;
+  // All member names concatenated.
+  std::string names_;
+  // Leaf node indices, in wire order.
+  std::vector<uint32_t> field_nodes_;
+  // Varbit node indices, in wire order.
+  std::vector<uint32_t> varbit_nodes_;
+};
+
+// P4 data view references a node of P4 data, which is either a leaf field or
+// an aggregate of them. It never outlives the P4 data it's created from, and
+// always sees its current buffer.
+//
+// Views of non-const P4 data may be written to, copying a shared buffer on the
+// first write rather than up front. Views of const P4 data are read-only, and
+// writing through them is a CHECK failure.
+class P4DataView {
+ public:
+  // Disallow copy constructor.
+  P4DataView(const P4DataView&) = delete;
+
+  // Disallow move constructor.
+  P4DataView(P4DataView&&) = default;
+
+  // Accesses member view by path relative to this node, like "c" or "s/c".
+  P4DataView operator[](absl::string_view path) const {
+    return {p4data_, mutable_p4data_, layout_->Resolve(node_, path)};
+  }
+
+  // Accesses member view by position.
+  P4DataView operator[](std::size_t index) const { return at(index); }
+
+  // Same as operator[], with bounds checking per the given policy.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  P4DataView at(std::size_t index) const {
+    return {p4data_, mutable_p4data_, layout_->Member<kCheck>(node_, index)};
+  }
+
+  // Copies the bits from the other view into this one, with the same semantics
+  // as BitField. Copying an aggregate is a single range copy, and takes along
+  // the lengths of the varbits within if both are of the same type.
+  P4DataView& operator=(const P4DataView& other);
+
+  // Copies the bits from the bit field into this view, with the same semantics
+  // as BitField. A varbit takes the width of the bit field as its length.
+  P4DataView& operator=(const BitField& other);
+
+  ~P4DataView() = default;
+
+  // Returns a read-only bit field covering this node, or only the value bits
+  // up to the current length for a varbit, with bounds checking per the given
+  // policy. Writes must go through the view or mutable_field() instead, since
+  // the buffer may be shared.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  BitField field() const;
+
+  // Same as field(), but for writing, copying a shared buffer first.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  BitField mutable_field();
+
+  operator BitField() const { return field(); }
+
+  // Returns the value of this node, like BitField::Load.
+  template <typename T>
+  T Load() const {
+    return field().Load<T>();
+  }
+
+  // Stores a value into this node, like BitField::Store. A varbit keeps its
+  // length.
+  template <typename T>
+  void Store(const T& value) {
+    mutable_field().Store(value);
+  }
+
+  // Returns the current length (in bits) of a varbit, or the width otherwise.
+  std::size_t length() const;
+
+  // Sets the current length (in bits) of a varbit, keeping the bits in the
+  // buffer, like after wrapping a packet whose header says how long the varbit
+  // is. Throws std::out_of_range if this is not a varbit.
+  void set_length(std::size_t length);
+
+  const P4Type& type() const { return layout_->node_type(node_); }
+
+  // Returns the offset (in bits).
+  std::size_t offset() const { return layout_->desc(node_).offset(); }
+
+  // Returns the width (in bits), which is the maximum for a varbit.
+  std::size_t width() const { return layout_->desc(node_).width(); }
+
+  std::size_t num_members() const { return layout_->num_members(node_); }
+
+  std::size_t node() const { return node_; }
+
+  // Returns whether the view may be written to.
+  bool writable() const { return mutable_p4data_ != nullptr; }
+
+  std::shared_ptr<const Buffer> buffer() const;
+
+ private:
+  friend class P4Data;
+
+  // Creates a view of the given node. mutable_p4data is either p4data, or null
+  // for a read-only view.
+  P4DataView(const P4Data* p4data, P4Data* mutable_p4data, std::size_t node);
+
+  // Returns a bit field covering this node in the given buffer, read-only for
+  // a const one.
+  template <BoundsCheck kCheck, typename BufferPtr>
+  BitField MakeField(BufferPtr buffer) const;
+
+  const P4Data* p4data_;
+  P4Data* mutable_p4data_;
+  const P4Layout* layout_;
+  std::size_t node_;
+};
+
+// P4 data holds a buffer of a P4 layout.
+//
+// Copies and clones share the buffer copy-on-write: the buffer is copied on the
+// first write through any of them, while views see the current buffer.
+//
+// Varbits take their maximum width in the buffer, so that it matches the wire
+// format. Their current lengths are held in a separate lengths buffer, which
+// goes along with the buffer.
+class P4Data {
+ public:
+  // Creates P4 data of the given type, with the layout interned by type.
+  P4Data(const P4Type& type, std::optional<uint8_t> init_val = std::nullopt);
+
+  // Creates P4 data sharing the given layout with others.
+  P4Data(std::shared_ptr<const P4Layout> layout,
+         std::optional<uint8_t> init_val = std::nullopt);
+
+  // Shares the buffer of the other P4 data copy-on-write, like Clone().
+  P4Data(const P4Data& other);
+  P4Data& operator=(const P4Data& other);
+
+  P4Data(P4Data&& other) noexcept;
+  P4Data& operator=(P4Data&& other) noexcept;
+
+  ~P4Data() = default;
+
+  // Creates P4 data on top of the given buffer, without copying it. The buffer
+  // must be large enough for the layout, and may wrap external data, like a
+  // packet whose leading bytes are parsed as the layout. Varbit lengths are
+  // wrapped likewise if given, or start at 0 otherwise. Writes go to the
+  // buffer, until the P4 data is cloned: then they copy it first.
+  static P4Data Wrap(std::shared_ptr<const P4Layout> layout,
+                     std::shared_ptr<Buffer> buffer,
+                     std::shared_ptr<Buffer> lengths = nullptr);
+
+  // Accesses view by path, like "/s/c", "s/c" or "s".
+  P4DataView operator[](absl::string_view path) {
+    return MutableView(layout_->Resolve(P4Layout::kRoot, path));
+  }
+
+  // Accesses top-level member view by position.
+  P4DataView operator[](std::size_t index) { return at(index); }
+
+  // Same as operator[], with bounds checking per the given policy.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  P4DataView at(std::size_t index) {
+    return MutableView(layout_->Member<kCheck>(P4Layout::kRoot, index));
+  }
+
+  // Accesses read-only view by path.
+  P4DataView operator[](absl::string_view path) const {
+    return View(layout_->Resolve(P4Layout::kRoot, path));
+  }
+
+  // Accesses read-only top-level member view by position.
+  P4DataView operator[](std::size_t index) const { return at(index); }
+
+  // Same as operator[], with bounds checking per the given policy.
+  template <BoundsCheck kCheck = kDefaultBoundsCheck>
+  P4DataView at(std::size_t index) const {
+    return View(layout_->Member<kCheck>(P4Layout::kRoot, index));
+  }
+
+  // Returns a copy-on-write clone sharing the buffer with this one.
+  P4Data Clone() const { return *this; }
+
+  void NewBuffer(std::optional<uint8_t> init_val = std::nullopt);
+
+  const P4Type& type() const { return layout_->type(); }
+
+  std::shared_ptr<const P4Layout> layout() const { return layout_; }
+
+  // Returns the buffer for reading, which may be shared with clones.
+  std::shared_ptr<const Buffer> buffer() const { return buffer_; }
+
+  // Returns the buffer for writing, copying a shared one first and allocating
+  // one if needed.
+  std::shared_ptr<Buffer> mutable_buffer();
+
+  // Returns the varbit lengths for reading, in the layout of
+  // P4Layout::lengths_size(), or null if there is no varbit or buffer.
+  std::shared_ptr<const Buffer> lengths() const { return lengths_; }
+
+  // Returns the varbit lengths for writing, like mutable_buffer().
+  std::shared_ptr<Buffer> mutable_lengths();
+
+  // Returns the current length (in bits) of the varbit at the given index, in
+  // wire order. There must be a buffer.
+  std::size_t varbit_length(std::size_t index) const;
+
+  // Sets the current length (in bits) of the varbit at the given index, which
+  // must not exceed its maximum. Copies shared buffers first.
+  void set_varbit_length(std::size_t index, std::size_t length);
+
+  // Returns whether the buffer may be shared with clones.
+  bool shared() const { return shared_.load(std::memory_order_relaxed); }
+
+ private:
+  friend class P4DataView;
+
+  P4DataView MutableView(std::size_t node) { return {this, this, node}; }
+
+  P4DataView View(std::size_t node) const { return {this, nullptr, node}; }
+
+  std::shared_ptr<const P4Layout> layout_;
   std::shared_ptr<Buffer> buffer_ = nullptr;
+  // Current varbit lengths, present along with buffer_ if there is a varbit.
+  std::shared_ptr<Buffer> lengths_ = nullptr;
+  // Whether buffer_ and lengths_ may be shared with clones. It's set on both
+  // sides by copies, which may run concurrently on the same P4 data, and
+  // cleared once a write made sure they are exclusive.
+  mutable std::atomic<bool> shared_ = false;
 };
 
+inline P4DataView::P4DataView(const P4Data* p4data, P4Data* mutable_p4data,
+                              std::size_t node)
+    : p4data_(p4data),
+      mutable_p4data_(mutable_p4data),
+      layout_(p4data->layout_.get()),
+      node_(node) {}
+
+template <BoundsCheck kCheck>
+BitField P4DataView::field() const {
+  return MakeField<kCheck>(p4data_->buffer());
+}
+
+template <BoundsCheck kCheck>
+BitField P4DataView::mutable_field() {
+  CHECK(mutable_p4data_ != nullptr) << "P4DataView: read-only view";
+  return MakeField<kCheck>(mutable_p4data_->mutable_buffer());
+}
+
+template <BoundsCheck kCheck, typename BufferPtr>
+BitField P4DataView::MakeField(BufferPtr buffer) const {
+  P4BUF_CHECK_BOUNDS(kCheck, buffer != nullptr);
+  const auto& desc = layout_->desc<kCheck>(node_);
+  std::size_t offset = desc.offset();
+  std::size_t width = desc.width();
+  if (std::holds_alternative<P4VarbitT>(
+          layout_->node_type<kCheck>(node_).variant())) {
+    width = p4data_->varbit_length(layout_->varbit_index(node_));
+  }
+  return BitField::Make<kCheck>(std::move(buffer), offset, width);
+}
+
+inline std::size_t P4DataView::length() const {
+  return layout_->is_varbit(node_)
+             ? p4data_->varbit_length(layout_->varbit_index(node_))
+             : width();
+}
+
+inline std::shared_ptr<const Buffer> P4DataView::buffer() const {
+  return p4data_->buffer();
+}
+
+// Compares the bits of two P4 data lexicographically, like BitField. Padding
+// bits past type().bitwidth() are ignored, and so are bits past the current
+// length of each varbit, if both are of the same type. Both must have a buffer.
+int Compare(const P4Data& lhs, const P4Data& rhs);
+
+// P4 data are equal if their types are equal and their bits are equal, padding
+// bits aside.
+inline bool operator==(const P4Data& lhs, const P4Data& rhs) {
+  return lhs.layout()->SameType(*rhs.layout()) && Compare(lhs, rhs) == 0;
+}
+inline bool operator!=(const P4Data& lhs, const P4Data& rhs) {
+  return !(lhs == rhs);
+}
+inline bool operator<(const P4Data& lhs, const P4Data& rhs) {
+  return Compare(lhs, rhs) < 0;
+}
+inline bool operator>(const P4Data& lhs, const P4Data& rhs) {
+  return Compare(lhs, rhs) > 0;
+}
+inline bool operator<=(const P4Data& lhs, const P4Data& rhs) {
+  return Compare(lhs, rhs) <= 0;
+}
+inline bool operator>=(const P4Data& lhs, const P4Data& rhs) {
+  return Compare(lhs, rhs) >= 0;
+}
+
+// Hashes the type and bits of P4 data, padding bits and bits past varbit
+// lengths aside, consistently with operator==. Makes P4 data usable with
+// absl::Hash. It must have a buffer.
+template <typename H>
+H AbslHashValue(H h, const P4Data& p4data) {
+  CHECK(p4data.buffer() != nullptr);
+  const P4Layout& layout = *p4data.layout();
+  const std::byte* data = p4data.buffer()->data();
+  h = H::combine(std::move(h), layout.type_hash());
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < layout.num_varbits(); ++i) {
+    const auto& desc = layout.desc(layout.varbit_node(i));
+    h = buffer_internal::HashBits(std::move(h), data, offset,
+                                  desc.offset() - offset);
+    h = buffer_internal::HashBits(std::move(h), data, desc.offset(),
+                                  p4data.varbit_length(i));
+    offset = desc.offset() + desc.width();
+  }
+  return buffer_internal::HashBits(std::move(h), data, offset,
+                                   layout.bitwidth() - offset);
+}
+
 }  // namespace p4buf
 
 #endif  // P4BUF_P4DATA_H_
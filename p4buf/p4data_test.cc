@@ -2,6 +2,9 @@
 
 #include <gtest/gtest.h>
 
+#include "absl/container/flat_hash_set.h"
+#include "absl/hash/hash.h"
+
 namespace p4buf {
 
 TEST(P4DataTest, P4TypeBasic) {
@@ -85,4 +88,470 @@ TEST(P4DataTest, P4TypeNested) {
   EXPECT_EQ(tuple_tuple_t[2][1].bitwidth(), 4);
 }
 
+TEST(P4DataTest, P4Layout) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{1}},
+      {"b", P4BitT{2}},
+      {"s",
+       P4StructT{
+           {"c", P4BitT{3}},
+           {"d", P4BitT{4}},
+       }},
+      {"t",
+       P4TupleT{
+           P4BitT{5},
+           P4BitT{6},
+       }},
+  });
+  P4Layout layout(p4type);
+  EXPECT_EQ(layout.bitwidth(), 21);
+  EXPECT_EQ(layout.byte_size(), 3);
+  EXPECT_EQ(layout.num_fields(), 6);
+
+  // Fields are in wire order.
+  EXPECT_EQ(layout.field(0).offset(), 0);
+  EXPECT_EQ(layout.field(0).width(), 1);
+  EXPECT_EQ(layout.field(5).offset(), 15);
+  EXPECT_EQ(layout.field(5).width(), 6);
+
+  // Fields are found by path.
+  EXPECT_EQ(layout.Find("/s/d"), 3);
+  EXPECT_EQ(layout.at("/s/d").offset(), 6);
+  EXPECT_EQ(layout.at("/s/d").width(), 4);
+  EXPECT_EQ(layout.Find("/t/1"), 5);
+  EXPECT_EQ(layout.Find("/s"), std::nullopt);
+  EXPECT_THROW(layout.at("/x"), std::out_of_range);
+  EXPECT_THROW(layout.at("/t/2"), std::out_of_range);
+  EXPECT_THROW(layout.at("/a/b"), std::out_of_range);
+
+  // Each field has a single path.
+  EXPECT_EQ(layout.Find("/t/0"), 4);
+  EXPECT_EQ(layout.Find("/t/00"), std::nullopt);
+  EXPECT_EQ(layout.Find("/t/01"), std::nullopt);
+  EXPECT_EQ(layout.Find("/t/+1"), std::nullopt);
+
+  // Nodes are resolved one member at a time.
+  auto s = layout.Member(P4Layout::kRoot, "s");
+  EXPECT_EQ(layout.name(s), "s");
+  EXPECT_EQ(layout.num_members(s), 2);
+  EXPECT_EQ(layout.desc(s).offset(), 3);
+  EXPECT_EQ(layout.desc(s).width(), 7);
+  EXPECT_EQ(layout.Member(s, "d"), layout.Member(s, 1));
+  EXPECT_EQ(layout.Member(s, "d"), layout.field_node(3));
+  EXPECT_EQ(layout.Resolve(s, "c"), layout.Resolve(P4Layout::kRoot, "/s/c"));
+  auto t = layout.Member(P4Layout::kRoot, 3);
+  EXPECT_EQ(layout.Member(t, "1"), layout.Member(t, 1));
+  EXPECT_FALSE(layout.is_field(t));
+  EXPECT_TRUE(layout.is_field(layout.Member(t, 1)));
+}
+
+TEST(P4DataTest, P4DataSharedLayout) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"a", P4BitT{4}},
+      {"b", P4BitT{4}},
+  }));
+  P4Data p4data1(layout, 0);
+  P4Data p4data2(layout, 0);
+  EXPECT_EQ(p4data1.layout(), p4data2.layout());
+
+  p4data1["/b"] = uint8_t{0x0a};
+  p4data2["/a"] = p4data1["/b"];
+  EXPECT_EQ(p4data1.buffer()->at(0), std::byte{0x0a});
+  EXPECT_EQ(p4data2.buffer()->at(0), std::byte{0xa0});
+}
+
+TEST(P4DataTest, P4TypeEquality) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{4}},
+      {"t", P4TupleT{P4BitT{4}, P4VarbitT{8}}},
+  });
+  EXPECT_EQ(p4type, P4Type(P4StructT{
+                        {"a", P4BitT{4}},
+                        {"t", P4TupleT{P4BitT{4}, P4VarbitT{8}}},
+                    }));
+  EXPECT_EQ(absl::Hash<P4Type>()(p4type),
+            absl::Hash<P4Type>()(P4Type(P4StructT{
+                {"a", P4BitT{4}},
+                {"t", P4TupleT{P4BitT{4}, P4VarbitT{8}}},
+            })));
+
+  // Names, order and kinds of members all matter.
+  EXPECT_NE(p4type, P4Type(P4StructT{
+                        {"b", P4BitT{4}},
+                        {"t", P4TupleT{P4BitT{4}, P4VarbitT{8}}},
+                    }));
+  EXPECT_NE(p4type, P4Type(P4StructT{
+                        {"t", P4TupleT{P4BitT{4}, P4VarbitT{8}}},
+                        {"a", P4BitT{4}},
+                    }));
+  EXPECT_NE(p4type, P4Type(P4StructT{
+                        {"a", P4BitT{4}},
+                        {"t", P4TupleT{P4BitT{4}, P4BitT{8}}},
+                    }));
+  EXPECT_NE(P4Type(P4TupleT{P4BitT{4}}), P4Type(P4StructT{{"a", P4BitT{4}}}));
+}
+
+TEST(P4DataTest, P4DataInternedLayout) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{4}},
+      {"b", P4BitT{4}},
+  });
+  P4Data p4data1(p4type, 0);
+  P4Data p4data2(P4Type(P4StructT{
+      {"a", P4BitT{4}},
+      {"b", P4BitT{4}},
+  }));
+  EXPECT_EQ(p4data1.layout(), p4data2.layout());
+  EXPECT_EQ(P4Layout::Intern(p4type), p4data1.layout());
+
+  P4Data p4data3(P4Type(P4StructT{
+      {"a", P4BitT{4}},
+      {"c", P4BitT{4}},
+  }));
+  EXPECT_NE(p4data1.layout(), p4data3.layout());
+
+  // Layouts of many short-lived types come and go, while live ones stay
+  // shared.
+  for (std::size_t width = 1; width <= 1000; ++width) {
+    auto layout = P4Layout::Intern(P4Type(P4StructT{{"a", P4BitT{width}}}));
+    EXPECT_EQ(layout->bitwidth(), width);
+    EXPECT_EQ(layout.use_count(), 1);
+  }
+  EXPECT_EQ(P4Layout::Intern(p4type), p4data1.layout());
+}
+
+TEST(P4DataTest, P4DataView) {
+  P4Data p4data(P4Type(P4StructT{
+                    {"a", P4BitT{1}},
+                    {"b", P4BitT{2}},
+                    {"s",
+                     P4StructT{
+                         {"c", P4BitT{3}},
+                         {"d", P4BitT{4}},
+                     }},
+                    {"u",
+                     P4StructT{
+                         {"c", P4BitT{3}},
+                         {"d", P4BitT{4}},
+                     }},
+                }),
+                0);
+
+  // Access members through sub-views, by name or position.
+  auto s = p4data["s"];
+  EXPECT_EQ(s.offset(), 3);
+  EXPECT_EQ(s.width(), 7);
+  EXPECT_EQ(s.num_members(), 2);
+  s["c"] = uint8_t{0b101};
+  s[1] = uint8_t{0b1001};
+  EXPECT_EQ(s["d"].offset(), p4data["/s/d"].offset());
+
+  // 00010110 01000000 00
+  // abbcccdd ddcccddd d.
+  EXPECT_EQ(p4data.buffer()->at(0), std::byte{0b0001'0110});
+  EXPECT_EQ(p4data.buffer()->at(1), std::byte{0b0100'0000});
+
+  // Copy a sub-struct as a whole.
+  p4data["u"] = p4data["s"];
+  EXPECT_EQ(p4data.buffer()->at(1), std::byte{0b0110'1100});
+  EXPECT_EQ(p4data.buffer()->at(2), std::byte{0b1000'0000});
+
+  // Top-level members by position.
+  EXPECT_EQ(p4data[3].offset(), 10);
+  EXPECT_THROW(p4data[4], std::out_of_range);
+  EXPECT_THROW(p4data["s/e"], std::out_of_range);
+
+  // Positions with explicit bounds checking policies.
+  EXPECT_EQ(p4data.at<BoundsCheck::kNever>(3).offset(), 10);
+  auto c = p4data["s"].at<BoundsCheck::kNever>(1);
+  EXPECT_EQ(c.field<BoundsCheck::kNever>().width(), 4);
+  EXPECT_THROW(p4data.at<BoundsCheck::kAlways>(4), std::out_of_range);
+  EXPECT_THROW(p4data["s"].at<BoundsCheck::kAlways>(3), std::out_of_range);
+}
+
+TEST(P4DataTest, P4DataClone) {
+  P4Data p4data(P4Type(P4StructT{
+                    {"a", P4BitT{8}},
+                    {"b", P4BitT{8}},
+                }),
+                0);
+  p4data["/a"] = uint8_t{1};
+
+  // A clone shares the buffer until written to.
+  P4Data clone = p4data.Clone();
+  EXPECT_EQ(clone.buffer(), p4data.buffer());
+  EXPECT_TRUE(clone.shared());
+  EXPECT_TRUE(p4data.shared());
+
+  // Reading keeps the buffer shared, even through views that may be written to.
+  EXPECT_EQ(std::as_const(clone)["/a"].width(), 8);
+  EXPECT_EQ(clone["/a"].Load<uint8_t>(), 1);
+  auto b = clone["/b"];
+  EXPECT_EQ(clone.buffer(), p4data.buffer());
+
+  // Views of a const P4Data are read-only.
+  EXPECT_FALSE(std::as_const(clone)["/a"].writable());
+  EXPECT_DEATH(std::as_const(clone)["/a"] = uint8_t{2}, "read-only");
+
+  // Writing copies the buffer first.
+  b = uint8_t{2};
+  EXPECT_NE(clone.buffer(), p4data.buffer());
+  EXPECT_FALSE(clone.shared());
+  EXPECT_EQ(clone.buffer()->at(0), std::byte{1});
+  EXPECT_EQ(clone.buffer()->at(1), std::byte{2});
+  EXPECT_EQ(p4data.buffer()->at(1), std::byte{0});
+
+  // The last holder of a buffer writes in place.
+  auto buffer = p4data.buffer().get();
+  p4data["/b"] = uint8_t{3};
+  EXPECT_EQ(p4data.buffer().get(), buffer);
+  EXPECT_FALSE(p4data.shared());
+  EXPECT_EQ(p4data.buffer()->at(1), std::byte{3});
+  EXPECT_EQ(clone.buffer()->at(1), std::byte{2});
+
+  // Copies share the buffer too.
+  P4Data copy = clone;
+  EXPECT_TRUE(copy.shared());
+  EXPECT_TRUE(clone.shared());
+  copy = p4data;
+  EXPECT_EQ(copy.buffer(), p4data.buffer());
+  copy["/a"] = uint8_t{4};
+  EXPECT_EQ(copy.buffer()->at(0), std::byte{4});
+  EXPECT_EQ(p4data.buffer()->at(0), std::byte{1});
+}
+
+TEST(P4DataTest, P4DataCloneBitField) {
+  P4Data p4data(P4Type(P4StructT{
+                    {"x", P4BitT{8}},
+                    {"y", P4BitT{8}},
+                }),
+                0);
+  P4Data clone = p4data.Clone();
+
+  // Bit fields converted from views are read-only, so they can't write into
+  // the shared buffer.
+  BitField field = clone["/x"];
+  EXPECT_FALSE(field.writable());
+  EXPECT_DEATH(field = uint8_t{7}, "read-only");
+  EXPECT_DEATH(std::as_const(clone)["/y"].field().Store(uint8_t{7}),
+               "read-only");
+
+  // Writes through a mutable bit field copy the buffer first.
+  BitField mutable_field = clone["/x"].mutable_field();
+  EXPECT_TRUE(mutable_field.writable());
+  mutable_field = uint8_t{7};
+  EXPECT_EQ(clone["/x"].Load<uint8_t>(), 7);
+  EXPECT_EQ(p4data["/x"].Load<uint8_t>(), 0);
+  EXPECT_EQ(p4data["/y"].Load<uint8_t>(), 0);
+}
+
+TEST(P4DataTest, P4DataCompare) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"a", P4BitT{3}},
+      {"b", P4BitT{64}},
+  }));
+
+  // Padding bits differ.
+  P4Data p4data1(layout, 0x00);
+  P4Data p4data2(layout, 0xff);
+  p4data2["a"] = uint8_t{0};
+  p4data2["b"] = uint64_t{0};
+  EXPECT_TRUE(p4data1 == p4data2);
+  EXPECT_EQ(absl::Hash<P4Data>()(p4data1), absl::Hash<P4Data>()(p4data2));
+
+  p4data2["b"] = uint64_t{1};
+  EXPECT_TRUE(p4data1 != p4data2);
+  EXPECT_TRUE(p4data1 < p4data2);
+  p4data1["a"] = uint8_t{1};
+  EXPECT_TRUE(p4data1 > p4data2);
+
+  absl::flat_hash_set<P4Data> set;
+  set.insert(p4data1.Clone());
+  set.insert(p4data2.Clone());
+  set.insert(p4data2.Clone());
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_TRUE(set.contains(p4data1));
+
+  // Equal types of different layouts.
+  P4Data p4data3(std::make_shared<const P4Layout>(layout->type()), 0);
+  p4data3["a"] = uint8_t{1};
+  EXPECT_TRUE(p4data3 == p4data1);
+  EXPECT_EQ(absl::Hash<P4Data>()(p4data3), absl::Hash<P4Data>()(p4data1));
+
+  // Different types of the same width.
+  P4Data p4data4(P4Type(P4StructT{
+                     {"c", P4BitT{3}},
+                     {"d", P4BitT{64}},
+                 }),
+                 0);
+  p4data4["c"] = uint8_t{1};
+  EXPECT_EQ(Compare(p4data4, p4data1), 0);
+  EXPECT_TRUE(p4data4 != p4data1);
+  EXPECT_NE(absl::Hash<P4Data>()(p4data4), absl::Hash<P4Data>()(p4data1));
+  EXPECT_FALSE(set.contains(p4data4));
+
+  // Hashing needs a buffer.
+  EXPECT_DEATH(absl::Hash<P4Data>()(P4Data(layout)), "");
+}
+
+TEST(P4DataTest, Varbit) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{3}},
+      {"options", P4VarbitT{40}},
+      {"b", P4BitT{5}},
+  });
+  // Wire format, up to the maximum length.
+  EXPECT_EQ(p4type.bitwidth(), 3 + 40 + 5);
+
+  P4Data p4data(p4type, 0xff);
+  auto layout = p4data.layout();
+  std::size_t options = layout->Resolve(P4Layout::kRoot, "options");
+  EXPECT_TRUE(layout->is_field(options));
+  EXPECT_TRUE(layout->is_varbit(options));
+  EXPECT_EQ(layout->num_fields(), 3);
+  EXPECT_EQ(layout->num_varbits(), 1);
+  EXPECT_EQ(layout->varbit_index(options), 0);
+  EXPECT_THROW(layout->varbit_index(P4Layout::kRoot), std::out_of_range);
+  EXPECT_EQ(p4data["options"].length(), 0);
+
+  // Assignment sets the length, and leaves the bits past it alone.
+  p4data["options"] =
+      BitField(std::make_shared<Buffer>(Buffer{0xab, 0xc0}), 0, 12);
+  EXPECT_EQ(p4data["options"].length(), 12);
+  EXPECT_EQ(p4data["options"].offset(), 3);
+  EXPECT_EQ(p4data["options"].width(), 40);
+  EXPECT_EQ(p4data["options"].Load<uint16_t>(), 0xabc);
+  EXPECT_EQ(p4data["a"].Load<uint8_t>(), 0x7);
+  EXPECT_EQ(p4data["b"].Load<uint8_t>(), 0x1f);
+  EXPECT_EQ(p4data.buffer()->at(2), std::byte{0xff});
+  EXPECT_EQ(p4data.buffer()->at(4), std::byte{0xff});
+
+  // Stores keep the length.
+  p4data["options"].Store(uint16_t{0x123});
+  EXPECT_EQ(p4data["options"].length(), 12);
+  EXPECT_EQ(p4data["options"].Load<uint16_t>(), 0x123);
+
+  // Bits past the length are ignored by comparisons.
+  P4Data other(p4type, 0);
+  other["a"] = p4data["a"];
+  other["b"] = p4data["b"];
+  other["options"] = p4data["options"];
+  EXPECT_TRUE(other == p4data);
+  EXPECT_EQ(absl::Hash<P4Data>()(other), absl::Hash<P4Data>()(p4data));
+  other["options"].set_length(13);
+  EXPECT_TRUE(other > p4data);
+
+  // Clones share the length copy-on-write.
+  P4Data clone = p4data.Clone();
+  clone["options"].set_length(4);
+  EXPECT_EQ(clone["options"].Load<uint8_t>(), 0x1);
+  EXPECT_EQ(p4data["options"].length(), 12);
+  EXPECT_NE(clone.lengths(), p4data.lengths());
+
+  // Into a fixed field, right-aligned.
+  other["b"] = p4data["options"];
+  EXPECT_EQ(other["b"].Load<uint8_t>(), 0x3);
+
+  p4data["options"] = BitField();
+  EXPECT_EQ(p4data["options"].length(), 0);
+  EXPECT_DEATH(p4data["options"] = BitField(uint64_t{0}), "");
+  EXPECT_DEATH(p4data["options"].set_length(41), "");
+  EXPECT_THROW(p4data["a"].set_length(1), std::out_of_range);
+}
+
+TEST(P4DataTest, VarbitWrap) {
+  // A header whose length field says how long the options are.
+  auto layout = P4Layout::Intern(P4Type(P4StructT{
+      {"len", P4BitT{8}},
+      {"options", P4VarbitT{32}},
+  }));
+  auto packet = std::make_shared<Buffer>(
+      Buffer{0x02, 0xca, 0xfe, 0x12, 0x34, 0x56, 0x78});
+  P4Data p4data = P4Data::Wrap(layout, packet);
+  EXPECT_EQ(p4data["options"].length(), 0);
+  p4data["options"].set_length(p4data["len"].Load<uint8_t>() * 8);
+  EXPECT_EQ(p4data["options"].Load<uint16_t>(), 0xcafe);
+  EXPECT_EQ(p4data.buffer(), packet);
+
+  // Lengths may be wrapped as well.
+  auto lengths = std::make_shared<Buffer>(Buffer{0x08, 0, 0, 0});
+  p4data = P4Data::Wrap(layout, packet, lengths);
+  EXPECT_EQ(p4data["options"].Load<uint8_t>(), 0xca);
+  p4data["options"].set_length(24);
+  EXPECT_EQ(lengths->at(0), std::byte{24});
+
+  // Once cloned, the wrapped buffers are copied before writing.
+  { P4Data clone = p4data.Clone(); }
+  p4data["len"] = uint8_t{9};
+  p4data["options"].set_length(8);
+  EXPECT_EQ(packet->at(0), std::byte{0x02});
+  EXPECT_EQ(lengths->at(0), std::byte{24});
+  EXPECT_EQ(p4data["len"].Load<uint8_t>(), 9);
+}
+
+TEST(P4DataTest, VarbitAggregateCopy) {
+  P4StructT header{
+      {"kind", P4BitT{4}},
+      {"opt", P4VarbitT{24}},
+  };
+  P4Data p4data(P4Type(P4StructT{
+                    {"s", header},
+                    {"u", header},
+                    {"t", P4TupleT{P4BitT{4}, P4VarbitT{24}}},
+                }),
+                0);
+  auto layout = p4data.layout();
+  EXPECT_EQ(layout->varbit_range(P4Layout::kRoot),
+            (std::pair<std::size_t, std::size_t>{0, 3}));
+  EXPECT_EQ(layout->varbit_range(layout->Resolve(P4Layout::kRoot, "u")),
+            (std::pair<std::size_t, std::size_t>{1, 2}));
+  EXPECT_EQ(layout->varbit_range(layout->Resolve(P4Layout::kRoot, "s/kind")),
+            (std::pair<std::size_t, std::size_t>{0, 0}));
+
+  p4data["s/kind"].Store(uint8_t{0x5});
+  p4data["s/opt"].set_length(16);
+  p4data["s/opt"].Store(uint16_t{0xbeef});
+
+  // Same type: the length comes along with the bits.
+  p4data["u"] = p4data["s"];
+  EXPECT_EQ(p4data["u/kind"].Load<uint8_t>(), 0x5);
+  EXPECT_EQ(p4data["u/opt"].length(), 16);
+  EXPECT_EQ(p4data["u/opt"].Load<uint16_t>(), 0xbeef);
+
+  // Across data, and copy-on-write.
+  P4Data clone = p4data.Clone();
+  clone["s/opt"].set_length(8);
+  p4data["u"] = clone["s"];
+  EXPECT_EQ(p4data["u/opt"].length(), 8);
+  EXPECT_EQ(clone["u/opt"].length(), 16);
+
+  // A different type of the same width only copies the bits.
+  p4data["t"] = p4data["s"];
+  EXPECT_EQ(p4data["t/0"].Load<uint8_t>(), 0x5);
+  EXPECT_EQ(p4data["t/1"].length(), 0);
+}
+
+TEST(P4DataTest, WideFields) {
+  P4Data p4data(P4Type(P4StructT{
+                    {"v", P4BitT{4}},
+                    {"src", P4BitT{128}},
+                    {"key", P4BitT{200}},
+                }),
+                0);
+  p4data["src"].Store(WideUint<2>{0x20010db800000000, 0x1});
+  EXPECT_EQ((p4data["src"].Load<WideUint<2>>()),
+            (WideUint<2>{0x20010db800000000, 0x1}));
+  EXPECT_EQ(p4data.buffer()->at(0), std::byte{0x02});
+  EXPECT_EQ(p4data.buffer()->at(1), std::byte{0x00});
+  EXPECT_EQ(p4data.buffer()->at(2), std::byte{0x10});
+  EXPECT_EQ(p4data.buffer()->at(3), std::byte{0xdb});
+
+  p4data["key"].Store(WideUint<4>{~uint64_t{0}, 1, 2, 3});
+  EXPECT_EQ((p4data["key"].Load<WideUint<4>>()),
+            (WideUint<4>{0xff, 1, 2, 3}));
+  p4data["key"] = p4data["src"];
+  EXPECT_EQ((p4data["key"].Load<WideUint<4>>()),
+            (WideUint<4>{0xff, 1, 0x20010db800000000, 0x1}));
+}
+
 }  // namespace p4buf
@@ -0,0 +1,165 @@
+#include "p4buf/pcap.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "absl/base/internal/endian.h"
+#include "absl/log/check.h"
+
+namespace p4buf {
+namespace {
+
+constexpr std::size_t kFileHeaderSize = 24;
+constexpr std::size_t kRecordHeaderSize = 16;
+
+constexpr uint32_t kMagicMicroseconds = 0xa1b2c3d4;
+constexpr uint32_t kMagicNanoseconds = 0xa1b23c4d;
+
+[[noreturn]] void ThrowErrno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+}  // namespace
+
+std::optional<P4Data> PcapPacket::Wrap(
+    std::shared_ptr<const P4Layout> layout) const {
+  if (data.size() < layout->byte_size()) {
+    return std::nullopt;
+  }
+  return P4Data::Wrap(std::move(layout), buffer());
+}
+
+PcapReader::PcapReader(const std::string& path, std::size_t window_size)
+    : window_size_(window_size), page_size_(sysconf(_SC_PAGESIZE)) {
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    ThrowErrno("open " + path);
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    int error = errno;
+    close(fd_);
+    errno = error;
+    ThrowErrno("fstat " + path);
+  }
+  file_size_ = st.st_size;
+
+  try {
+    if (file_size_ < kFileHeaderSize) {
+      throw std::runtime_error("not a pcap file: " + path);
+    }
+    MapWindow(0, kFileHeaderSize);
+
+    uint32_t magic;
+    std::memcpy(&magic, map_, sizeof(magic));
+    if (magic == kMagicMicroseconds || magic == kMagicNanoseconds) {
+      swapped_ = false;
+    } else if (absl::gbswap_32(magic) == kMagicMicroseconds ||
+               absl::gbswap_32(magic) == kMagicNanoseconds) {
+      swapped_ = true;
+      magic = absl::gbswap_32(magic);
+    } else {
+      throw std::runtime_error("not a pcap file: " + path);
+    }
+    nanosecond_ = magic == kMagicNanoseconds;
+    snaplen_ = Read32(map_ + 16);
+    link_type_ = Read32(map_ + 20);
+    offset_ = kFileHeaderSize;
+  } catch (...) {
+    if (map_ != nullptr) {
+      munmap(map_, map_size_);
+    }
+    close(fd_);
+    throw;
+  }
+}
+
+PcapReader::~PcapReader() {
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+  }
+  close(fd_);
+}
+
+std::size_t PcapReader::NextBatch(std::vector<PcapPacket>& packets,
+                                  std::size_t max_packets) {
+  CHECK(max_packets > 0);
+  packets.clear();
+  while (packets.size() < max_packets && offset_ < file_size_) {
+    if (file_size_ - offset_ < kRecordHeaderSize) {
+      throw std::runtime_error("truncated pcap record header");
+    }
+    // Make sure the record header is mapped. Remapping invalidates packets
+    // already in the batch, so end the batch instead.
+    if (offset_ + kRecordHeaderSize > map_offset_ + map_size_) {
+      if (!packets.empty()) {
+        break;
+      }
+      MapWindow(offset_, kRecordHeaderSize);
+    }
+    const std::byte* header = map_ + (offset_ - map_offset_);
+    uint64_t ts_sec = Read32(header);
+    uint64_t ts_frac = Read32(header + 4);
+    std::size_t incl_len = Read32(header + 8);
+    uint32_t orig_len = Read32(header + 12);
+
+    std::size_t record_size = kRecordHeaderSize + incl_len;
+    if (record_size > file_size_ - offset_) {
+      throw std::runtime_error("truncated pcap record");
+    }
+    if (offset_ + record_size > map_offset_ + map_size_) {
+      if (!packets.empty()) {
+        break;
+      }
+      MapWindow(offset_, record_size);
+    }
+
+    PcapPacket& packet = packets.emplace_back();
+    packet.timestamp_ns =
+        ts_sec * 1'000'000'000 + (nanosecond_ ? ts_frac : ts_frac * 1'000);
+    packet.orig_len = orig_len;
+    packet.data = absl::MakeSpan(
+        map_ + (offset_ - map_offset_) + kRecordHeaderSize, incl_len);
+    offset_ += record_size;
+  }
+  return packets.size();
+}
+
+void PcapReader::MapWindow(std::size_t offset, std::size_t size) {
+  if (map_ != nullptr) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+  }
+
+  std::size_t begin = offset / page_size_ * page_size_;
+  std::size_t end = std::max(offset + size, begin + window_size_);
+  end = std::min(end, file_size_);
+  map_size_ = end - begin;
+  map_offset_ = begin;
+
+  void* map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd_, begin);
+  if (map == MAP_FAILED) {
+    map_size_ = 0;
+    ThrowErrno("mmap");
+  }
+  map_ = static_cast<std::byte*>(map);
+  madvise(map_, map_size_, MADV_SEQUENTIAL);
+}
+
+uint32_t PcapReader::Read32(const std::byte* data) const {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return swapped_ ? absl::gbswap_32(value) : value;
+}
+
+}  // namespace p4buf
@@ -0,0 +1,102 @@
+// Streaming pcap file reader.
+
+#ifndef P4BUF_PCAP_H_
+#define P4BUF_PCAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "p4buf/buffer.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// A packet record of a pcap file.
+struct PcapPacket {
+  // Capture time, in nanoseconds since the epoch.
+  uint64_t timestamp_ns = 0;
+  // Length of the packet on the wire, which may exceed the captured data.
+  uint32_t orig_len = 0;
+  // Captured data, pointing into the mapped file.
+  absl::Span<std::byte> data;
+
+  // Returns a buffer wrapping the captured data, without copying it.
+  std::shared_ptr<Buffer> buffer() const {
+    return std::make_shared<Buffer>(Buffer::Wrap(data.data(), data.size()));
+  }
+
+  // Returns P4 data wrapping the captured data as the layout, without copying
+  // it, or std::nullopt if too little was captured for the layout. Snaplen and
+  // runt frames make short packets common, so they are left to the caller.
+  std::optional<P4Data> Wrap(std::shared_ptr<const P4Layout> layout) const;
+};
+
+// Pcap reader streams packets out of a classic pcap file (not pcapng) by
+// memory-mapping a window of the file at a time. Memory use is bounded by the
+// window size, no matter how large the file is.
+//
+// The file is mapped privately, so packet data can be edited in place (e.g.
+// through P4Data wrapping it) without touching the file; edited pages are
+// copied by the kernel on first write.
+class PcapReader {
+ public:
+  // Opens a pcap file, and reads its header. Throws std::system_error if the
+  // file can't be opened or mapped, or std::runtime_error if it's not a pcap
+  // file.
+  explicit PcapReader(const std::string& path,
+                      std::size_t window_size = std::size_t{64} << 20);
+
+  PcapReader(const PcapReader&) = delete;
+  PcapReader& operator=(const PcapReader&) = delete;
+
+  ~PcapReader();
+
+  // Replaces the content of packets with up to max_packets (which must be
+  // positive) next packets, and returns how many. Returns 0 at the end of the
+  // file. Packet data is valid until the next call. Throws std::runtime_error
+  // on a truncated record, header included.
+  std::size_t NextBatch(std::vector<PcapPacket>& packets,
+                        std::size_t max_packets);
+
+  // Returns the link-layer header type, like 1 for Ethernet.
+  uint32_t link_type() const { return link_type_; }
+
+  // Returns the maximum captured length of packets.
+  uint32_t snaplen() const { return snaplen_; }
+
+ private:
+  // Maps the window of the file starting at offset (rounded down to a page),
+  // covering at least size bytes.
+  void MapWindow(std::size_t offset, std::size_t size);
+
+  // Reads a 32-bit header field in the file byte order.
+  uint32_t Read32(const std::byte* data) const;
+
+  int fd_ = -1;
+  std::size_t file_size_ = 0;
+  std::size_t window_size_;
+  std::size_t page_size_;
+
+  // Current mapping, covering the file range [map_offset_, map_offset_ +
+  // map_size_).
+  std::byte* map_ = nullptr;
+  std::size_t map_offset_ = 0;
+  std::size_t map_size_ = 0;
+
+  // File offset of the next record.
+  std::size_t offset_ = 0;
+
+  bool swapped_ = false;
+  bool nanosecond_ = false;
+  uint32_t link_type_ = 0;
+  uint32_t snaplen_ = 0;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_PCAP_H_
@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "p4buf/pcap.h"
+
+namespace p4buf {
+namespace {
+
+constexpr int kNumPackets = 1 << 16;
+
+// Writes a pcap file of Ethernet packets of 64 to 1518 bytes, and returns its
+// path.
+std::string WritePcap() {
+  auto put32 = [](std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  auto put16 = [](std::string& out, uint16_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  std::string out;
+  put32(out, 0xa1b2c3d4);
+  put16(out, 2);
+  put16(out, 4);
+  put32(out, 0);
+  put32(out, 0);
+  put32(out, 65535);
+  put32(out, 1);
+  for (int i = 0; i < kNumPackets; ++i) {
+    uint32_t size = 64 + i * 7919 % (1518 - 64 + 1);
+    put32(out, i / 1000);
+    put32(out, i % 1000);
+    put32(out, size);
+    put32(out, size);
+    out.append(size, static_cast<char>(i));
+  }
+
+  std::string path = "/tmp/pcap_benchmark." + std::to_string(getpid());
+  std::ofstream(path, std::ios::binary) << out;
+  return path;
+}
+
+// An Ethernet header.
+std::shared_ptr<const P4Layout> EthernetLayout() {
+  return std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"dst_addr", P4BitT{48}},
+      {"src_addr", P4BitT{48}},
+      {"ether_type", P4BitT{16}},
+  }));
+}
+
+// Streams the whole file in batches, wrapping every packet long enough as P4
+// data and reading a field of it, given the window size in MiB and the batch
+// size.
+void BM_PcapReaderNextBatch(benchmark::State& state) {
+  std::string path = WritePcap();
+  auto layout = EthernetLayout();
+  std::size_t window_size = static_cast<std::size_t>(state.range(0)) << 20;
+  std::size_t batch_size = state.range(1);
+  std::vector<PcapPacket> packets;
+  int64_t num_bytes = 0;
+
+  for (auto _ : state) {
+    PcapReader reader(path, window_size);
+    while (reader.NextBatch(packets, batch_size) > 0) {
+      for (const auto& packet : packets) {
+        if (auto p4data = packet.Wrap(layout)) {
+          benchmark::DoNotOptimize((*p4data)["ether_type"].Load<uint16_t>());
+        }
+        num_bytes += packet.data.size();
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kNumPackets);
+  state.SetBytesProcessed(num_bytes);
+  std::remove(path.c_str());
+}
+BENCHMARK(BM_PcapReaderNextBatch)
+    ->Args({1, 32})
+    ->Args({64, 32})
+    ->Args({64, 256})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace p4buf
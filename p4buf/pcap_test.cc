@@ -0,0 +1,165 @@
+#include "p4buf/pcap.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "absl/base/internal/endian.h"
+
+namespace p4buf {
+namespace {
+
+// Writes a pcap file of packets, where packet i has i % 200 + 1 bytes, all
+// set to i % 256.
+std::string WritePcap(const std::string& name, int num_packets,
+                      bool big_endian) {
+  auto put32 = [big_endian](std::string& out, uint32_t value) {
+    value = big_endian ? absl::ghtonl(value) : value;
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  auto put16 = [big_endian](std::string& out, uint16_t value) {
+    value = big_endian ? absl::ghtons(value) : value;
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  std::string out;
+  put32(out, 0xa1b2c3d4);
+  put16(out, 2);
+  put16(out, 4);
+  put32(out, 0);
+  put32(out, 0);
+  put32(out, 65535);
+  put32(out, 1);
+  for (int i = 0; i < num_packets; ++i) {
+    uint32_t size = i % 200 + 1;
+    put32(out, 1000 + i);
+    put32(out, i);
+    put32(out, size);
+    put32(out, size + 10);
+    out.append(size, static_cast<char>(i % 256));
+  }
+
+  std::string path = testing::TempDir() + "/" + name;
+  std::ofstream(path, std::ios::binary) << out;
+  return path;
+}
+
+}  // namespace
+
+TEST(PcapTest, ReadInBatches) {
+  for (bool big_endian : {false, true}) {
+    constexpr int kNumPackets = 1000;
+    std::string path = WritePcap("read.pcap", kNumPackets, big_endian);
+
+    // A small window forces many remaps.
+    PcapReader reader(path, 4096);
+    EXPECT_EQ(reader.link_type(), 1);
+    EXPECT_EQ(reader.snaplen(), 65535);
+
+    std::vector<PcapPacket> packets;
+    int i = 0;
+    while (reader.NextBatch(packets, 16) > 0) {
+      EXPECT_LE(packets.size(), 16);
+      for (const auto& packet : packets) {
+        uint32_t size = i % 200 + 1;
+        EXPECT_EQ(packet.timestamp_ns,
+                  (1000 + i) * 1'000'000'000ull + i * 1'000);
+        EXPECT_EQ(packet.orig_len, size + 10);
+        ASSERT_EQ(packet.data.size(), size);
+        EXPECT_EQ(packet.data.front(), std::byte(i % 256));
+        EXPECT_EQ(packet.data.back(), std::byte(i % 256));
+        ++i;
+      }
+    }
+    EXPECT_EQ(i, kNumPackets);
+    std::remove(path.c_str());
+  }
+}
+
+TEST(PcapTest, WrapPacketsWithoutCopy) {
+  std::string path = WritePcap("wrap.pcap", 10, false);
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"a", P4BitT{4}},
+      {"b", P4BitT{4}},
+  }));
+
+  {
+    PcapReader reader(path);
+    std::vector<PcapPacket> packets;
+    ASSERT_EQ(reader.NextBatch(packets, 10), 10);
+
+    // Edit a packet in place.
+    auto p4data = *packets[5].Wrap(layout);
+    EXPECT_EQ(p4data.buffer()->data(), packets[5].data.data());
+    EXPECT_FALSE(p4data.buffer()->owned());
+    p4data["b"] = uint8_t{0xf};
+    EXPECT_EQ(packets[5].data[0], std::byte{0x0f});
+  }
+
+  // The file is left intact.
+  PcapReader reader(path);
+  std::vector<PcapPacket> packets;
+  ASSERT_EQ(reader.NextBatch(packets, 10), 10);
+  EXPECT_EQ(packets[5].data[0], std::byte{5});
+  std::remove(path.c_str());
+}
+
+TEST(PcapTest, WrapShortPackets) {
+  // Packets have 1 to 10 bytes.
+  std::string path = WritePcap("short.pcap", 10, false);
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"src", P4BitT{16}},
+      {"dst", P4BitT{16}},
+  }));
+
+  PcapReader reader(path);
+  std::vector<PcapPacket> packets;
+  ASSERT_EQ(reader.NextBatch(packets, 10), 10);
+  for (std::size_t i = 0; i < packets.size(); ++i) {
+    std::optional<P4Data> p4data = packets[i].Wrap(layout);
+    EXPECT_EQ(p4data.has_value(), i >= 3) << i;
+    if (p4data.has_value()) {
+      EXPECT_EQ((*p4data)["dst"].Load<uint16_t>(), i * 0x101);
+      EXPECT_EQ(p4data->buffer()->data(), packets[i].data.data());
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(PcapTest, Errors) {
+  EXPECT_THROW(PcapReader(testing::TempDir() + "/missing.pcap"),
+               std::system_error);
+
+  std::string path = testing::TempDir() + "/bad.pcap";
+  std::ofstream(path, std::ios::binary) << std::string(100, 'x');
+  EXPECT_THROW(PcapReader{path}, std::runtime_error);
+  std::remove(path.c_str());
+
+  // Cut the last record short.
+  path = WritePcap("truncated.pcap", 3, false);
+  truncate(path.c_str(), 24 + 16 + 1 + 16 + 2 + 16 + 1);
+  PcapReader reader(path);
+  std::vector<PcapPacket> packets;
+  EXPECT_THROW(reader.NextBatch(packets, 10), std::runtime_error);
+  std::remove(path.c_str());
+
+  // Cut the last record header short.
+  path = WritePcap("truncated_header.pcap", 3, false);
+  truncate(path.c_str(), 24 + 16 + 1 + 16 + 2 + 5);
+  PcapReader header_reader(path);
+  EXPECT_THROW(header_reader.NextBatch(packets, 10), std::runtime_error);
+  std::remove(path.c_str());
+
+  // Batches must hold packets, or they would look like the end of the file.
+  path = WritePcap("empty_batch.pcap", 3, false);
+  PcapReader empty_batch_reader(path);
+  EXPECT_DEATH(empty_batch_reader.NextBatch(packets, 0), "");
+  std::remove(path.c_str());
+}
+
+}  // namespace p4buf
@@ -0,0 +1,172 @@
+#include "p4buf/pipeline.h"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "absl/log/check.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace p4buf {
+namespace {
+
+// Pins the calling thread to the CPU, on a best-effort basis.
+void PinToCpu(int cpu) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+// Pushes the value, waiting while the ring is full. Returns false if the
+// pipeline stops meanwhile.
+template <typename T>
+bool Push(SpscRing<T>& ring, T value, uint64_t& stalls,
+          const std::atomic<bool>& stop) {
+  while (!ring.TryPush(std::move(value))) {
+    if (stop.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    ++stalls;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+// Pops a value, waiting while the ring is empty. Returns false if the pipeline
+// stops meanwhile.
+template <typename T>
+bool Pop(SpscRing<T>& ring, T& value, uint64_t& stalls,
+         const std::atomic<bool>& stop) {
+  while (!ring.TryPop(value)) {
+    if (stop.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    ++stalls;
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+}  // namespace
+
+Pipeline::Pipeline(std::shared_ptr<const P4Layout> layout, Options options)
+    : layout_(std::move(layout)), options_(std::move(options)) {
+  CHECK(options_.batch_size > 0);
+  CHECK(options_.ring_capacity > 0);
+}
+
+void Pipeline::Run(const Source& source) {
+  CHECK(!stages_.empty());
+  std::size_t num_stages = stages_.size();
+
+  // Enough batches to fill every ring, plus one held by each thread.
+  if (batches_.empty()) {
+    std::size_t num_batches =
+        options_.ring_capacity * num_stages + num_stages + 1;
+    for (std::size_t i = 0; i < num_batches; ++i) {
+      batches_.push_back(std::make_unique<P4DataBatch>(
+          layout_, options_.batch_size, 0));
+    }
+  }
+
+  // Ring i feeds stage i. The free ring takes batches back to the source, and
+  // never fills up.
+  std::vector<std::unique_ptr<SpscRing<Handle>>> rings;
+  for (std::size_t i = 0; i < num_stages; ++i) {
+    rings.push_back(
+        std::make_unique<SpscRing<Handle>>(options_.ring_capacity));
+  }
+  SpscRing<Handle> free_ring(batches_.size());
+  for (auto& batch : batches_) {
+    free_ring.TryPush(Handle{batch.get(), 0});
+  }
+
+  stats_.assign(num_stages + 1, Stats{});
+  std::vector<std::thread> threads;
+
+  // The first exception thrown by the source or a stage stops every thread,
+  // and is rethrown once they have all exited.
+  std::atomic<bool> stop = false;
+  std::mutex mutex;
+  std::exception_ptr exception;
+
+  // Starts the thread with the given index, pinned per the options.
+  auto start = [&](std::size_t index, std::function<void()> body) {
+    threads.emplace_back([&, index, body = std::move(body)]() {
+      if (index < options_.cpus.size() && options_.cpus[index] >= 0) {
+        PinToCpu(options_.cpus[index]);
+      }
+      try {
+        body();
+      } catch (...) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (exception == nullptr) {
+            exception = std::current_exception();
+          }
+        }
+        stop.store(true, std::memory_order_relaxed);
+      }
+    });
+  };
+
+  start(0, [&]() {
+    auto& stats = stats_[0];
+    Handle handle;
+    while (Pop(free_ring, handle, stats.input_stalls, stop)) {
+      handle.size = source(absl::MakeSpan(handle.batch->data(),
+                                          handle.batch->size()));
+      if (handle.size == 0) {
+        Push(*rings[0], Handle{}, stats.output_stalls, stop);
+        return;
+      }
+      CHECK(handle.size <= handle.batch->size());
+      ++stats.batches;
+      stats.records += handle.size;
+      if (!Push(*rings[0], handle, stats.output_stalls, stop)) {
+        return;
+      }
+    }
+  });
+
+  for (std::size_t i = 0; i < num_stages; ++i) {
+    start(i + 1, [&, i]() {
+      auto& stats = stats_[i + 1];
+      auto& input = *rings[i];
+      auto& output = i + 1 < num_stages ? *rings[i + 1] : free_ring;
+      Handle handle;
+      while (Pop(input, handle, stats.input_stalls, stop)) {
+        if (handle.batch == nullptr) {
+          // Pass the end of the stream on, except to the source.
+          if (i + 1 < num_stages) {
+            Push(output, handle, stats.output_stalls, stop);
+          }
+          return;
+        }
+        stages_[i](absl::MakeSpan(handle.batch->data(), handle.size));
+        ++stats.batches;
+        stats.records += handle.size;
+        if (!Push(output, handle, stats.output_stalls, stop)) {
+          return;
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (exception != nullptr) {
+    std::rethrow_exception(exception);
+  }
+}
+
+}  // namespace p4buf
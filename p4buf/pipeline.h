@@ -0,0 +1,94 @@
+// Pipelined stage runtime.
+
+#ifndef P4BUF_PIPELINE_H_
+#define P4BUF_PIPELINE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "p4buf/batch.h"
+#include "p4buf/p4data.h"
+#include "p4buf/spsc_ring.h"
+
+namespace p4buf {
+
+// Pipeline runs a source and a chain of stages, each on its own thread, and
+// passes batches of P4 data between them over SPSC rings. A full ring makes
+// the upstream thread wait, so a slow stage throttles the whole pipeline.
+//
+// Batches are allocated once. After the last stage, a batch goes back to the
+// source over another ring, and its records (buffers included) are refilled in
+// place.
+class Pipeline {
+ public:
+  struct Options {
+    // Maximum number of records per batch.
+    std::size_t batch_size = 32;
+    // Capacity (in batches) of each ring between threads.
+    std::size_t ring_capacity = 16;
+    // CPUs to pin the source and stage threads to, in order. Threads beyond
+    // the list, or with a negative CPU, are not pinned. Only done on Linux.
+    std::vector<int> cpus;
+  };
+
+  // Source fills up to records.size() records, and returns how many it
+  // filled. Returning 0 ends the stream.
+  using Source = std::function<std::size_t(absl::Span<P4Data> records)>;
+
+  // Stage processes the records of a batch.
+  using Stage = std::function<void(absl::Span<P4Data> records)>;
+
+  // Counters for tuning batch size and ring capacity. Each thread updates its
+  // own, so they take a cache line each.
+  struct alignas(64) Stats {
+    // Number of batches processed.
+    uint64_t batches = 0;
+    // Number of records processed.
+    uint64_t records = 0;
+    // Number of times the thread found its input ring empty.
+    uint64_t input_stalls = 0;
+    // Number of times the thread found its output ring full.
+    uint64_t output_stalls = 0;
+  };
+
+  Pipeline(std::shared_ptr<const P4Layout> layout, Options options);
+
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  // Appends a stage to the chain.
+  void AddStage(Stage stage) { stages_.push_back(std::move(stage)); }
+
+  // Runs the pipeline until the source ends the stream and every batch has
+  // gone through all stages. If the source or a stage throws, the pipeline
+  // stops without finishing the batches in flight, and the first exception is
+  // rethrown.
+  void Run(const Source& source);
+
+  // Returns counters of the last run, for the source first and then for each
+  // stage.
+  const std::vector<Stats>& stats() const { return stats_; }
+
+ private:
+  // Batch handle passed over rings. A null batch marks the end of the stream.
+  struct Handle {
+    P4DataBatch* batch = nullptr;
+    std::size_t size = 0;
+  };
+
+  std::shared_ptr<const P4Layout> layout_;
+  Options options_;
+  std::vector<Stage> stages_;
+  std::vector<Stats> stats_;
+  // Batch pool, allocated on the first run.
+  std::vector<std::unique_ptr<P4DataBatch>> batches_;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_PIPELINE_H_
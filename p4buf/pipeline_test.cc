@@ -0,0 +1,180 @@
+#include "p4buf/pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <stdexcept>
+
+namespace p4buf {
+
+TEST(PipelineTest, Run) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"seq", P4BitT{32}},
+      {"ttl", P4BitT{8}},
+  }));
+  Pipeline::Options options;
+  options.batch_size = 7;
+  options.ring_capacity = 2;
+  Pipeline pipeline(layout, options);
+
+  // Parse: set TTL.
+  pipeline.AddStage([](absl::Span<P4Data> records) {
+    for (auto& record : records) {
+      record["ttl"] = uint8_t{64};
+    }
+  });
+
+  // Deparse: check records arrive in order, and collect buffers seen.
+  uint32_t next_seq = 0;
+  std::set<const Buffer*> buffers;
+  pipeline.AddStage([&](absl::Span<P4Data> records) {
+    for (auto& record : records) {
+      const auto& buffer = *record.buffer();
+      uint32_t seq = (std::to_integer<uint32_t>(buffer.at(2)) << 8) |
+                     std::to_integer<uint32_t>(buffer.at(3));
+      EXPECT_EQ(seq, next_seq++);
+      EXPECT_EQ(buffer.at(4), std::byte{64});
+      buffers.insert(&buffer);
+    }
+  });
+
+  constexpr uint32_t kCount = 1000;
+  uint32_t seq = 0;
+  pipeline.Run([&seq](absl::Span<P4Data> records) -> std::size_t {
+    std::size_t size = 0;
+    for (; size < records.size() && seq < kCount; ++size, ++seq) {
+      records[size]["seq"] = seq;
+      records[size]["ttl"] = uint8_t{0};
+    }
+    return size;
+  });
+
+  EXPECT_EQ(next_seq, kCount);
+  ASSERT_EQ(pipeline.stats().size(), 3);
+  for (const auto& stats : pipeline.stats()) {
+    EXPECT_EQ(stats.records, kCount);
+    EXPECT_EQ(stats.batches, (kCount + 6) / 7);
+  }
+
+  // Buffers are recycled, not reallocated per batch.
+  EXPECT_LE(buffers.size(), 7 * (2 * 2 + 2 + 1));
+
+  // The pipeline can run again.
+  seq = 0;
+  next_seq = 0;
+  pipeline.Run([&seq](absl::Span<P4Data> records) -> std::size_t {
+    std::size_t size = 0;
+    for (; size < records.size() && seq < 10; ++size, ++seq) {
+      records[size]["seq"] = seq;
+    }
+    return size;
+  });
+  EXPECT_EQ(next_seq, 10);
+}
+
+// Returns a source of count records, numbered from 0.
+Pipeline::Source CountingSource(uint32_t count) {
+  return [count, seq = uint32_t{0}](absl::Span<P4Data> records) mutable {
+    std::size_t size = 0;
+    for (; size < records.size() && seq < count; ++size, ++seq) {
+      records[size]["seq"] = seq;
+      records[size]["ttl"] = uint8_t{0};
+    }
+    return size;
+  };
+}
+
+std::shared_ptr<const P4Layout> PacketLayout() {
+  return std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"seq", P4BitT{32}},
+      {"ttl", P4BitT{8}},
+  }));
+}
+
+TEST(PipelineTest, MultipleStages) {
+  Pipeline::Options options;
+  options.batch_size = 5;
+  options.ring_capacity = 1;
+  Pipeline pipeline(PacketLayout(), options);
+
+  // Each stage sees the work of the one before.
+  constexpr int kStages = 4;
+  for (int i = 0; i < kStages; ++i) {
+    pipeline.AddStage([i](absl::Span<P4Data> records) {
+      for (auto& record : records) {
+        EXPECT_EQ(record["ttl"].Load<uint8_t>(), i);
+        record["ttl"] = uint8_t(i + 1);
+      }
+    });
+  }
+  std::size_t count = 0;
+  pipeline.AddStage([&](absl::Span<P4Data> records) {
+    for (auto& record : records) {
+      EXPECT_EQ(record["ttl"].Load<uint8_t>(), kStages);
+    }
+    count += records.size();
+  });
+
+  pipeline.Run(CountingSource(123));
+  EXPECT_EQ(count, 123);
+  ASSERT_EQ(pipeline.stats().size(), kStages + 2);
+  for (const auto& stats : pipeline.stats()) {
+    EXPECT_EQ(stats.records, 123);
+    EXPECT_EQ(stats.batches, 25);
+  }
+}
+
+TEST(PipelineTest, EmptySource) {
+  Pipeline pipeline(PacketLayout(), Pipeline::Options());
+  int calls = 0;
+  pipeline.AddStage([&calls](absl::Span<P4Data>) { ++calls; });
+  pipeline.AddStage([&calls](absl::Span<P4Data>) { ++calls; });
+
+  pipeline.Run(CountingSource(0));
+  EXPECT_EQ(calls, 0);
+  for (const auto& stats : pipeline.stats()) {
+    EXPECT_EQ(stats.records, 0);
+    EXPECT_EQ(stats.batches, 0);
+  }
+}
+
+TEST(PipelineTest, Exception) {
+  Pipeline::Options options;
+  options.batch_size = 4;
+  options.ring_capacity = 2;
+  Pipeline pipeline(PacketLayout(), options);
+  bool fail = true;
+  pipeline.AddStage([](absl::Span<P4Data>) {});
+  pipeline.AddStage([&fail](absl::Span<P4Data> records) {
+    for (auto& record : records) {
+      if (fail && record["seq"].Load<uint32_t>() == 50) {
+        throw std::runtime_error("stage");
+      }
+    }
+  });
+  pipeline.AddStage([](absl::Span<P4Data>) {});
+
+  // An endless source, stopped by the stage.
+  uint32_t seq = 0;
+  auto endless = [&seq](absl::Span<P4Data> records) {
+    for (auto& record : records) {
+      record["seq"] = seq++;
+    }
+    return records.size();
+  };
+  EXPECT_THROW(pipeline.Run(endless), std::runtime_error);
+  EXPECT_LE(pipeline.stats()[2].records, 48);
+
+  // From the source.
+  EXPECT_THROW(pipeline.Run([](absl::Span<P4Data>) -> std::size_t {
+                 throw std::out_of_range("source");
+               }),
+               std::out_of_range);
+
+  // The pipeline can run again.
+  fail = false;
+  pipeline.Run(CountingSource(100));
+  EXPECT_EQ(pipeline.stats().back().records, 100);
+}
+
+}  // namespace p4buf
@@ -0,0 +1,132 @@
+#include "p4buf/register.h"
+
+#include <cstring>
+
+#include "absl/log/check.h"
+#include "p4buf/bit.h"
+
+namespace p4buf {
+namespace {
+
+// Returns the shard of the calling thread. Threads are spread over shards in
+// the order they first get here.
+std::size_t ThisThreadShard(std::size_t num_shards) {
+  static std::atomic<std::size_t> next_id{0};
+  thread_local std::size_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+  return id % num_shards;
+}
+
+}  // namespace
+
+RegisterArray::RegisterArray(const P4Type& type, std::size_t size,
+                             std::size_t num_shards)
+    : RegisterArray(std::make_shared<const P4Layout>(type), size, num_shards) {
+}
+
+RegisterArray::RegisterArray(std::shared_ptr<const P4Layout> layout,
+                             std::size_t size, std::size_t num_shards)
+    : layout_(std::move(layout)), size_(size), num_shards_(num_shards) {
+  CHECK(layout_->bitwidth() > 0);
+  CHECK(layout_->num_varbits() == 0);
+  CHECK(num_shards_ > 0);
+  if (lock_free()) {
+    shard_stride_ = (size_ + 7) / 8 * 8;
+    lines_.reset(new Line[num_shards_ * shard_stride_ / 8]);
+  } else {
+    CHECK(num_shards_ == 1);
+    cell_size_ = layout_->byte_size();
+    bytes_.reset(new std::byte[size_ * cell_size_]);
+    locks_.reset(new std::mutex[kNumLockStripes]);
+  }
+  Clear();
+}
+
+uint64_t RegisterArray::Load(std::size_t index) const {
+  CHECK(lock_free() && index < size_);
+  uint64_t value = 0;
+  for (std::size_t shard = 0; shard < num_shards_; ++shard) {
+    value += word(shard, index).load(std::memory_order_relaxed);
+  }
+  return value & mask();
+}
+
+void RegisterArray::Store(std::size_t index, uint64_t value) {
+  CHECK(lock_free() && num_shards_ == 1 && index < size_);
+  word(0, index).store(value & mask(), std::memory_order_relaxed);
+}
+
+void RegisterArray::Add(std::size_t index, uint64_t delta) {
+  CHECK(lock_free() && index < size_);
+  // Words may carry bits beyond the cell width, which are masked on load.
+  std::size_t shard = num_shards_ == 1 ? 0 : ThisThreadShard(num_shards_);
+  word(shard, index).fetch_add(delta, std::memory_order_relaxed);
+}
+
+uint64_t RegisterArray::FetchAdd(std::size_t index, uint64_t delta) {
+  CHECK(lock_free() && num_shards_ == 1 && index < size_);
+  return word(0, index).fetch_add(delta, std::memory_order_relaxed) & mask();
+}
+
+bool RegisterArray::CompareExchange(std::size_t index, uint64_t& expected,
+                                    uint64_t desired) {
+  CHECK(lock_free() && num_shards_ == 1 && index < size_);
+  auto& cell = word(0, index);
+  uint64_t current = cell.load(std::memory_order_relaxed);
+  // Retry while the word only differs in bits beyond the cell width.
+  while ((current & mask()) == (expected & mask())) {
+    if (cell.compare_exchange_weak(current, desired & mask(),
+                                   std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  expected = current & mask();
+  return false;
+}
+
+void RegisterArray::Read(std::size_t index, P4Data& p4data) const {
+  CHECK(index < size_);
+  CHECK(p4data.layout()->SameType(*layout_))
+      << "RegisterArray: P4 data of another type";
+  auto buffer = p4data.mutable_buffer();
+  if (lock_free()) {
+    BitStore(buffer->data(), 0, layout_->bitwidth(), Load(index));
+  } else {
+    std::lock_guard<std::mutex> lock(locks_[index % kNumLockStripes]);
+    std::memcpy(buffer->data(), bytes_.get() + index * cell_size_, cell_size_);
+  }
+  buffer->MarkDirty(0, buffer->size());
+}
+
+void RegisterArray::Write(std::size_t index, const P4Data& p4data) {
+  CHECK(index < size_);
+  CHECK(p4data.layout()->SameType(*layout_))
+      << "RegisterArray: P4 data of another type";
+  CHECK(p4data.buffer() != nullptr);
+  const std::byte* data = p4data.buffer()->data();
+  if (lock_free()) {
+    Store(index, BitLoad(data, 0, layout_->bitwidth()));
+  } else {
+    std::lock_guard<std::mutex> lock(locks_[index % kNumLockStripes]);
+    std::memcpy(bytes_.get() + index * cell_size_, data, cell_size_);
+  }
+}
+
+void RegisterArray::Clear() {
+  if (lock_free()) {
+    for (std::size_t shard = 0; shard < num_shards_; ++shard) {
+      for (std::size_t index = 0; index < shard_stride_; ++index) {
+        word(shard, index).store(0, std::memory_order_relaxed);
+      }
+    }
+  } else {
+    for (std::size_t stripe = 0; stripe < kNumLockStripes; ++stripe) {
+      locks_[stripe].lock();
+    }
+    std::memset(bytes_.get(), 0, size_ * cell_size_);
+    for (std::size_t stripe = 0; stripe < kNumLockStripes; ++stripe) {
+      locks_[stripe].unlock();
+    }
+  }
+}
+
+}  // namespace p4buf
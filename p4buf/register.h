@@ -0,0 +1,107 @@
+// Arrays of P4 registers, counters and meters.
+
+#ifndef P4BUF_REGISTER_H_
+#define P4BUF_REGISTER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// Register array holds cells of a P4 type in one contiguous allocation.
+//
+// Cells of at most 64 bits are stored in atomic words, each holding the bits of
+// a cell read as a big-endian integer, and are updated lock-free. Wider cells
+// are stored bit-packed at a byte-aligned stride, and guarded by striped locks.
+// As in P4, cells may not hold varbits.
+//
+// With more than one shard (cells of at most 64 bits only), each thread adds to
+// its own copy of the array, and loads merge all shards by summing them. This
+// keeps counters updated from many cores free of contention.
+class RegisterArray {
+ public:
+  // Creates an array of the given number of cells, all set to 0.
+  RegisterArray(const P4Type& type, std::size_t size,
+                std::size_t num_shards = 1);
+
+  // Creates an array of the given number of cells sharing the given layout, all
+  // set to 0.
+  RegisterArray(std::shared_ptr<const P4Layout> layout, std::size_t size,
+                std::size_t num_shards = 1);
+
+  // Returns the value of a cell of at most 64 bits, merging all shards.
+  uint64_t Load(std::size_t index) const;
+
+  // Sets the value of a cell of at most 64 bits. Requires a single shard.
+  void Store(std::size_t index, uint64_t value);
+
+  // Adds to the value of a cell of at most 64 bits, wrapping around at its
+  // width. With multiple shards, only the calling thread's shard is touched.
+  void Add(std::size_t index, uint64_t delta);
+
+  // Adds to the value of a cell of at most 64 bits, and returns the previous
+  // value. Requires a single shard.
+  uint64_t FetchAdd(std::size_t index, uint64_t delta);
+
+  // Sets the value of a cell of at most 64 bits to desired if it equals
+  // expected. Otherwise, loads the current value into expected. Requires a
+  // single shard.
+  bool CompareExchange(std::size_t index, uint64_t& expected, uint64_t desired);
+
+  // Copies a cell of any width into the P4 data, which must be of the same
+  // type as the layout.
+  void Read(std::size_t index, P4Data& p4data) const;
+
+  // Copies the P4 data, which must be of the same type as the layout, into a
+  // cell of any width. Requires a single shard.
+  void Write(std::size_t index, const P4Data& p4data);
+
+  // Sets all cells to 0. Not atomic with respect to concurrent updates.
+  void Clear();
+
+  std::size_t size() const { return size_; }
+
+  std::size_t num_shards() const { return num_shards_; }
+
+  std::shared_ptr<const P4Layout> layout() const { return layout_; }
+
+  // Returns whether cells are stored in atomic words.
+  bool lock_free() const { return layout_->bitwidth() <= 64; }
+
+ private:
+  static constexpr std::size_t kNumLockStripes = 64;
+
+  // Cache line of atomic words, so that shards never share a line.
+  struct alignas(64) Line {
+    std::atomic<uint64_t> words[8];
+  };
+
+  std::atomic<uint64_t>& word(std::size_t shard, std::size_t index) const {
+    std::size_t i = shard * shard_stride_ + index;
+    return lines_[i / 8].words[i % 8];
+  }
+
+  uint64_t mask() const { return ~uint64_t{0} >> (64 - layout_->bitwidth()); }
+
+  std::shared_ptr<const P4Layout> layout_;
+  std::size_t size_;
+  std::size_t num_shards_;
+
+  // Storage of cells of at most 64 bits. Each shard takes shard_stride_ words.
+  std::size_t shard_stride_ = 0;
+  std::unique_ptr<Line[]> lines_ = nullptr;
+
+  // Storage of wider cells.
+  std::size_t cell_size_ = 0;
+  std::unique_ptr<std::byte[]> bytes_ = nullptr;
+  std::unique_ptr<std::mutex[]> locks_ = nullptr;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_REGISTER_H_
@@ -0,0 +1,112 @@
+#include "p4buf/register.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace p4buf {
+
+TEST(RegisterArrayTest, LockFreeCells) {
+  RegisterArray registers(P4Type(P4BitT{12}), 10);
+  EXPECT_TRUE(registers.lock_free());
+  EXPECT_EQ(registers.size(), 10);
+  EXPECT_EQ(registers.Load(3), 0);
+
+  registers.Store(3, 0xabc);
+  EXPECT_EQ(registers.Load(3), 0xabc);
+
+  // Values wrap around at the cell width.
+  EXPECT_EQ(registers.FetchAdd(3, 0x545), 0xabc);
+  EXPECT_EQ(registers.Load(3), 0x001);
+  registers.Store(4, 0x1fff);
+  EXPECT_EQ(registers.Load(4), 0xfff);
+
+  uint64_t expected = 0x002;
+  EXPECT_FALSE(registers.CompareExchange(3, expected, 0x100));
+  EXPECT_EQ(expected, 0x001);
+  EXPECT_TRUE(registers.CompareExchange(3, expected, 0x100));
+  EXPECT_EQ(registers.Load(3), 0x100);
+
+  registers.Clear();
+  EXPECT_EQ(registers.Load(3), 0);
+}
+
+TEST(RegisterArrayTest, ReadAndWriteP4Data) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"a", P4BitT{4}},
+      {"b", P4BitT{8}},
+  }));
+  RegisterArray registers(layout, 4);
+  P4Data p4data(layout, 0);
+  p4data["a"] = uint8_t{0x1};
+  p4data["b"] = uint8_t{0x23};
+
+  registers.Write(2, p4data);
+  EXPECT_EQ(registers.Load(2), 0x123);
+
+  P4Data out(layout, 0);
+  registers.Read(2, out);
+  EXPECT_EQ(out.buffer()->at(0), std::byte{0x12});
+  EXPECT_EQ(out.buffer()->at(1), std::byte{0x30});
+
+  // Same width, but another type.
+  P4Data other(P4Type(P4StructT{
+                   {"a", P4BitT{8}},
+                   {"b", P4BitT{4}},
+               }),
+               0);
+  EXPECT_DEATH(registers.Write(2, other), "another type");
+  EXPECT_DEATH(registers.Read(2, other), "another type");
+
+  // Another layout of the same type is fine.
+  P4Data same(std::make_shared<const P4Layout>(layout->type()), 0);
+  registers.Read(2, same);
+  EXPECT_TRUE(same == out);
+}
+
+TEST(RegisterArrayTest, WideCells) {
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4TupleT{
+      P4BitT{64},
+      P4BitT{64},
+  }));
+  RegisterArray registers(layout, 4);
+  EXPECT_FALSE(registers.lock_free());
+
+  P4Data p4data(layout, 0);
+  p4data[0] = uint64_t{1};
+  p4data[1] = uint64_t{2};
+  registers.Write(1, p4data);
+
+  P4Data out(layout, 0xff);
+  registers.Read(0, out);
+  EXPECT_EQ(out.buffer()->at(15), std::byte{0});
+  registers.Read(1, out);
+  EXPECT_EQ(out.buffer()->at(7), std::byte{1});
+  EXPECT_EQ(out.buffer()->at(15), std::byte{2});
+}
+
+TEST(RegisterArrayTest, ConcurrentAdds) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumAdds = 10000;
+
+  for (std::size_t num_shards : {1, kNumThreads}) {
+    RegisterArray counters(P4Type(P4BitT{64}), 2, num_shards);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.emplace_back([&counters]() {
+        for (int j = 0; j < kNumAdds; ++j) {
+          counters.Add(0, 1);
+          counters.Add(1, 100);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(counters.Load(0), kNumThreads * kNumAdds);
+    EXPECT_EQ(counters.Load(1), kNumThreads * kNumAdds * 100);
+  }
+}
+
+}  // namespace p4buf
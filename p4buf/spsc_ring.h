@@ -0,0 +1,90 @@
+// Bounded lock-free single-producer/single-consumer ring.
+
+#ifndef P4BUF_SPSC_RING_H_
+#define P4BUF_SPSC_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "absl/log/check.h"
+
+namespace p4buf {
+
+// SPSC ring is a bounded FIFO queue for exactly one producer thread and one
+// consumer thread. Neither side ever blocks or locks: a full ring rejects
+// pushes, and an empty one rejects pops, leaving the caller to decide how to
+// wait.
+template <typename T>
+class SpscRing {
+ public:
+  // Creates a ring holding at least the given number of elements. The capacity
+  // is rounded up to a power of 2.
+  explicit SpscRing(std::size_t capacity) {
+    CHECK(capacity > 0);
+    while (capacity_ < capacity) {
+      capacity_ *= 2;
+    }
+    slots_.reset(new T[capacity_]);
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Moves the value into the ring. Returns false if the ring is full. Only
+  // called by the producer.
+  bool TryPush(T&& value) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == capacity_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == capacity_) {
+        return false;
+      }
+    }
+    slots_[tail & (capacity_ - 1)] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPush(const T& value) { return TryPush(T(value)); }
+
+  // Moves the oldest value out of the ring. Returns false if the ring is
+  // empty. Only called by the consumer.
+  bool TryPop(T& value) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    value = std::move(slots_[head & (capacity_ - 1)]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns the number of elements, which may be stale by the time it's used.
+  std::size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() const { return capacity_; }
+
+ private:
+  std::size_t capacity_ = 1;
+  std::unique_ptr<T[]> slots_;
+
+  // Consumer side: the next slot to pop, and the last tail seen.
+  alignas(64) std::atomic<std::size_t> head_{0};
+  std::size_t cached_tail_ = 0;
+
+  // Producer side: the next slot to push, and the last head seen.
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  std::size_t cached_head_ = 0;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_SPSC_RING_H_
@@ -0,0 +1,51 @@
+#include "p4buf/spsc_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace p4buf {
+
+TEST(SpscRingTest, PushAndPop) {
+  SpscRing<int> ring(3);
+  EXPECT_EQ(ring.capacity(), 4);
+
+  int value;
+  EXPECT_FALSE(ring.TryPop(value));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.TryPush(i));
+  }
+  EXPECT_FALSE(ring.TryPush(4));
+  EXPECT_EQ(ring.size(), 4);
+
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.TryPop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(ring.TryPop(value));
+}
+
+TEST(SpscRingTest, ConcurrentProducerAndConsumer) {
+  constexpr int kCount = 100000;
+  SpscRing<std::unique_ptr<int>> ring(16);
+
+  std::thread producer([&ring]() {
+    for (int i = 0; i < kCount; ++i) {
+      auto value = std::make_unique<int>(i);
+      while (!ring.TryPush(std::move(value))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  for (int i = 0; i < kCount; ++i) {
+    std::unique_ptr<int> value;
+    while (!ring.TryPop(value)) {
+      std::this_thread::yield();
+    }
+    ASSERT_EQ(*value, i);
+  }
+  producer.join();
+}
+
+}  // namespace p4buf
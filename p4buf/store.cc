@@ -0,0 +1,261 @@
+#include "p4buf/store.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include "absl/base/internal/endian.h"
+#include "absl/log/check.h"
+#include "absl/strings/string_view.h"
+
+namespace p4buf {
+namespace {
+
+// Header layout, in little endian.
+constexpr char kMagic[8] = {'P', '4', 'B', 'U', 'F', 'S', 'T', 'O'};
+constexpr uint32_t kVersion = 2;
+constexpr std::size_t kVersionOffset = 8;
+constexpr std::size_t kRecordSizeOffset = 12;
+constexpr std::size_t kFingerprintOffset = 16;
+constexpr std::size_t kSizeOffset = 24;
+constexpr std::size_t kCapacityOffset = 32;
+constexpr std::size_t kCheckpointSizeOffset = 40;
+constexpr std::size_t kCheckpointChecksumOffset = 48;
+
+[[noreturn]] void ThrowErrno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// 64-bit FNV-1a, which is simple and stable.
+class Fnv1a {
+ public:
+  void Add(absl::string_view bytes) {
+    for (char c : bytes) {
+      hash_ = (hash_ ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+  }
+
+  void Add(uint64_t value) {
+    char bytes[8];
+    absl::little_endian::Store64(bytes, value);
+    Add(absl::string_view(bytes, sizeof(bytes)));
+  }
+
+  uint64_t hash() const { return hash_; }
+
+ private:
+  uint64_t hash_ = 0xcbf29ce484222325;
+};
+
+}  // namespace
+
+P4DataStore::P4DataStore(const std::string& path,
+                         std::shared_ptr<const P4Layout> layout,
+                         std::size_t capacity)
+    : layout_(std::move(layout)),
+      record_size_(layout_->byte_size() + layout_->lengths_size()) {
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    ThrowErrno("open " + path);
+  }
+
+  try {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+      ThrowErrno("fstat " + path);
+    }
+    std::size_t file_size = st.st_size;
+    uint64_t fingerprint = Fingerprint(*layout_);
+
+    if (file_size == 0) {
+      // A new store.
+      file_size = kHeaderSize + capacity * record_size_;
+      if (ftruncate(fd_, file_size) != 0) {
+        ThrowErrno("ftruncate " + path);
+      }
+      Map(file_size);
+      std::memcpy(map_, kMagic, sizeof(kMagic));
+      absl::little_endian::Store32(map_ + kVersionOffset, kVersion);
+      absl::little_endian::Store32(map_ + kRecordSizeOffset, record_size_);
+      absl::little_endian::Store64(map_ + kFingerprintOffset, fingerprint);
+      absl::little_endian::Store64(map_ + kSizeOffset, 0);
+      absl::little_endian::Store64(map_ + kCapacityOffset, capacity);
+      absl::little_endian::Store64(map_ + kCheckpointSizeOffset, 0);
+      absl::little_endian::Store64(map_ + kCheckpointChecksumOffset,
+                                   Checksum(0));
+      return;
+    }
+
+    // An existing store, which must match the layout.
+    if (file_size < kHeaderSize) {
+      throw std::runtime_error("not a P4 data store: " + path);
+    }
+    Map(file_size);
+    if (std::memcmp(map_, kMagic, sizeof(kMagic)) != 0 ||
+        absl::little_endian::Load32(map_ + kVersionOffset) != kVersion) {
+      throw std::runtime_error("not a P4 data store: " + path);
+    }
+    if (absl::little_endian::Load32(map_ + kRecordSizeOffset) !=
+            record_size_ ||
+        absl::little_endian::Load64(map_ + kFingerprintOffset) !=
+            fingerprint) {
+      throw std::runtime_error("P4 data store of another layout: " + path);
+    }
+    if (size() > this->capacity() || checkpoint_size() > this->capacity() ||
+        kHeaderSize + this->capacity() * record_size_ > file_size) {
+      throw std::runtime_error("corrupted P4 data store: " + path);
+    }
+  } catch (...) {
+    if (map_ != nullptr) {
+      munmap(map_, map_size_);
+    }
+    close(fd_);
+    throw;
+  }
+}
+
+P4DataStore::~P4DataStore() {
+  munmap(map_, map_size_);
+  close(fd_);
+}
+
+P4Data P4DataStore::operator[](std::size_t index) { return Record(index); }
+
+const P4Data P4DataStore::operator[](std::size_t index) const {
+  // A clone, so that copies of it (elided or not) copy before writing.
+  return Record(index).Clone();
+}
+
+P4Data P4DataStore::Record(std::size_t index) const {
+  CHECK(index < size());
+  std::size_t byte_size = layout_->byte_size();
+  std::shared_ptr<Buffer> lengths;
+  if (layout_->num_varbits() > 0) {
+    lengths = std::make_shared<Buffer>(
+        Buffer::Wrap(record(index) + byte_size, layout_->lengths_size()));
+  }
+  return P4Data::Wrap(
+      layout_,
+      std::make_shared<Buffer>(Buffer::Wrap(record(index), byte_size)),
+      std::move(lengths));
+}
+
+std::size_t P4DataStore::Append() {
+  std::size_t index = size();
+  Resize(index + 1);
+  return index;
+}
+
+std::size_t P4DataStore::Append(const P4Data& p4data) {
+  CHECK(p4data.layout()->SameType(*layout_))
+      << "P4DataStore: record of another type";
+  std::size_t byte_size = layout_->byte_size();
+  CHECK(p4data.buffer() != nullptr && p4data.buffer()->size() >= byte_size);
+  std::size_t index = Append();
+  std::memcpy(record(index), p4data.buffer()->data(), byte_size);
+  if (auto lengths = p4data.lengths()) {
+    std::memcpy(record(index) + byte_size, lengths->data(), lengths->size());
+  }
+  return index;
+}
+
+void P4DataStore::Resize(std::size_t size) {
+  std::size_t old_size = this->size();
+  if (size > capacity()) {
+    Reserve(std::max(size, capacity() * 2));
+  }
+  if (size > old_size) {
+    std::memset(record(old_size), 0, (size - old_size) * record_size_);
+  }
+  absl::little_endian::Store64(map_ + kSizeOffset, size);
+}
+
+void P4DataStore::Reserve(std::size_t capacity) {
+  if (capacity <= this->capacity()) {
+    return;
+  }
+  std::size_t file_size = kHeaderSize + capacity * record_size_;
+  if (ftruncate(fd_, file_size) != 0) {
+    ThrowErrno("ftruncate");
+  }
+  munmap(map_, map_size_);
+  map_ = nullptr;
+  Map(file_size);
+  absl::little_endian::Store64(map_ + kCapacityOffset, capacity);
+}
+
+void P4DataStore::Checkpoint() {
+  std::size_t size = this->size();
+  uint64_t checksum = Checksum(size);
+  if (msync(map_, map_size_, MS_SYNC) != 0) {
+    ThrowErrno("msync");
+  }
+
+  // Commit the checkpoint only once the records are on the disk. The header
+  // fits in a sector, so it's written whole or not at all.
+  absl::little_endian::Store64(map_ + kCheckpointSizeOffset, size);
+  absl::little_endian::Store64(map_ + kCheckpointChecksumOffset, checksum);
+  if (msync(map_, kHeaderSize, MS_SYNC) != 0) {
+    ThrowErrno("msync");
+  }
+}
+
+bool P4DataStore::MatchesCheckpoint() const {
+  return size() == checkpoint_size() &&
+         Checksum(size()) ==
+             absl::little_endian::Load64(map_ + kCheckpointChecksumOffset);
+}
+
+std::size_t P4DataStore::checkpoint_size() const {
+  return absl::little_endian::Load64(map_ + kCheckpointSizeOffset);
+}
+
+std::size_t P4DataStore::size() const {
+  return absl::little_endian::Load64(map_ + kSizeOffset);
+}
+
+std::size_t P4DataStore::capacity() const {
+  return absl::little_endian::Load64(map_ + kCapacityOffset);
+}
+
+uint64_t P4DataStore::Fingerprint(const P4Layout& layout) {
+  // Nodes are numbered in a fixed order, so their names and descriptors
+  // capture the whole type tree.
+  Fnv1a fnv;
+  for (std::size_t node = 0; node < layout.num_nodes(); ++node) {
+    absl::string_view name = layout.name(node);
+    fnv.Add(name.size());
+    fnv.Add(name);
+    fnv.Add(layout.desc(node).offset());
+    fnv.Add(layout.desc(node).width());
+    fnv.Add(layout.num_members(node));
+    fnv.Add(uint64_t{layout.is_field(node)} + 2 * layout.is_varbit(node));
+  }
+  return fnv.hash();
+}
+
+uint64_t P4DataStore::Checksum(std::size_t size) const {
+  Fnv1a fnv;
+  fnv.Add(absl::string_view(reinterpret_cast<const char*>(record(0)),
+                            size * record_size_));
+  return fnv.hash();
+}
+
+void P4DataStore::Map(std::size_t file_size) {
+  void* map =
+      mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    ThrowErrno("mmap");
+  }
+  map_ = static_cast<std::byte*>(map);
+  map_size_ = file_size;
+}
+
+}  // namespace p4buf
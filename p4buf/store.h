@@ -0,0 +1,122 @@
+// Persistent P4 data store.
+
+#ifndef P4BUF_STORE_H_
+#define P4BUF_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "p4buf/buffer.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// P4 data store keeps an array of same-layout P4 data records in a
+// memory-mapped file, like a table or register snapshot, so that it survives
+// process restarts. Reopening the file maps the records back in place, without
+// reading or parsing them.
+//
+// The file starts with a small header identifying the layout by a fingerprint
+// of its type tree, followed by the records back to back, record_size() bytes
+// each. A record is the buffer of the layout, followed by its varbit lengths if
+// it has any.
+//
+// Records are accessed as P4 data wrapping the mapped file, and writes go
+// straight to the page cache, so they outlive a process crash. Checkpoint()
+// flushes them to the disk, to outlive a system crash as well. Only then does
+// it record the number of records and their checksum in the header, so that
+// after a system crash, MatchesCheckpoint() tells whether writes since the
+// last checkpoint, possibly torn, made it to the disk.
+class P4DataStore {
+ public:
+  // Opens the store file at path, creating it (with room for capacity records)
+  // if it doesn't exist. Throws std::system_error if the file can't be opened
+  // or mapped, or std::runtime_error if it's not a store of the layout.
+  P4DataStore(const std::string& path, std::shared_ptr<const P4Layout> layout,
+              std::size_t capacity = 1024);
+
+  P4DataStore(const P4DataStore&) = delete;
+  P4DataStore& operator=(const P4DataStore&) = delete;
+
+  ~P4DataStore();
+
+  // Accesses the record at the given index in place, with bounds checking.
+  // Records stay valid until the file is remapped to grow, or the store is
+  // destroyed.
+  P4Data operator[](std::size_t index);
+
+  // Accesses the record at the given index for reading. Copies of it share the
+  // record copy-on-write, so writes to them leave the file alone.
+  const P4Data operator[](std::size_t index) const;
+
+  // Appends a record with all bits (and varbit lengths) set to 0, growing the
+  // file if needed. Returns its index.
+  std::size_t Append();
+
+  // Appends a copy of the given P4 data, which must be of the same type as the
+  // layout. Returns its index.
+  std::size_t Append(const P4Data& p4data);
+
+  // Sets the number of records. New records have all bits set to 0.
+  void Resize(std::size_t size);
+
+  // Grows the file to hold at least capacity records.
+  void Reserve(std::size_t capacity);
+
+  // Flushes the header and all records to the disk, and waits for it, then
+  // commits a checkpoint of them. Only dirty pages are written, but all the
+  // records are read for the checksum. Throws std::system_error on failure.
+  void Checkpoint();
+
+  // Returns whether the records are the same as at the last checkpoint,
+  // reading them all. If not after a system crash, Resize(checkpoint_size())
+  // drops the records appended since, but those written in place may be torn.
+  bool MatchesCheckpoint() const;
+
+  // Returns the number of records at the last checkpoint.
+  std::size_t checkpoint_size() const;
+
+  // Returns the number of records.
+  std::size_t size() const;
+
+  // Returns the number of records the file has room for.
+  std::size_t capacity() const;
+
+  // Returns the size (in bytes) of a record.
+  std::size_t record_size() const { return record_size_; }
+
+  std::shared_ptr<const P4Layout> layout() const { return layout_; }
+
+  // Returns a fingerprint of the layout's type tree, stable across processes
+  // and builds.
+  static uint64_t Fingerprint(const P4Layout& layout);
+
+ private:
+  // Maps the whole file, of the given size.
+  void Map(std::size_t file_size);
+
+  // Returns the checksum of the first size records.
+  uint64_t Checksum(std::size_t size) const;
+
+  // Wraps the record at the given index, with bounds checking.
+  P4Data Record(std::size_t index) const;
+
+  // Returns a pointer to the record at the given index.
+  std::byte* record(std::size_t index) const {
+    return map_ + kHeaderSize + index * record_size_;
+  }
+
+  static constexpr std::size_t kHeaderSize = 64;
+
+  std::shared_ptr<const P4Layout> layout_;
+  std::size_t record_size_;
+  int fd_ = -1;
+  std::byte* map_ = nullptr;
+  std::size_t map_size_ = 0;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_STORE_H_
@@ -0,0 +1,201 @@
+#include "p4buf/store.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace p4buf {
+namespace {
+
+std::shared_ptr<const P4Layout> EntryLayout() {
+  return std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"key", P4BitT{12}},
+      {"value", P4BitT{40}},
+  }));
+}
+
+std::string StorePath(const std::string& name) {
+  std::string path = testing::TempDir() + "/" + name;
+  std::remove(path.c_str());
+  return path;
+}
+
+TEST(P4DataStoreTest, AppendAndReopen) {
+  std::string path = StorePath("append.p4store");
+  auto layout = EntryLayout();
+  {
+    P4DataStore store(path, layout, 4);
+    EXPECT_EQ(store.size(), 0);
+    EXPECT_EQ(store.capacity(), 4);
+    EXPECT_EQ(store.record_size(), 7);
+
+    // Grow past the initial capacity.
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(store.Append(), i);
+      P4Data entry = store[i];
+      entry["key"] = uint16_t(i);
+      entry["value"] = uint32_t(i * 1000);
+    }
+    EXPECT_EQ(store.size(), 10);
+    EXPECT_GE(store.capacity(), 10);
+
+    P4Data p4data(layout, 0);
+    p4data["key"] = uint16_t{0xabc};
+    EXPECT_EQ(store.Append(p4data), 10);
+    store.Checkpoint();
+  }
+
+  // Records are mapped back in place.
+  P4DataStore store(path, layout);
+  ASSERT_EQ(store.size(), 11);
+  for (int i = 0; i < 10; ++i) {
+    P4Data expected(layout, 0);
+    expected["key"] = uint16_t(i);
+    expected["value"] = uint32_t(i * 1000);
+    EXPECT_TRUE(store[i] == expected) << i;
+  }
+  EXPECT_EQ(BitLoad(store[10].buffer()->data(), 0, 12), 0xabc);
+
+  // Writes go to the file in place.
+  EXPECT_FALSE(store[3].buffer()->owned());
+  store[3]["value"] = uint64_t{7};
+  EXPECT_EQ(BitLoad(store[3].buffer()->data(), 12, 40), 7);
+}
+
+TEST(P4DataStoreTest, VarbitLengths) {
+  std::string path = StorePath("varbit.p4store");
+  auto layout = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"key", P4BitT{8}},
+      {"options", P4VarbitT{32}},
+  }));
+  {
+    P4DataStore store(path, layout);
+    // The buffer, then a 4-byte length.
+    EXPECT_EQ(store.record_size(), 5 + 4);
+    store.Append();
+    store[0]["options"] = BitField({0xab});
+
+    P4Data p4data(layout, 0);
+    p4data["options"] = BitField({0x12, 0x34});
+    EXPECT_EQ(store.Append(p4data), 1);
+  }
+
+  P4DataStore store(path, layout);
+  EXPECT_EQ(store[0]["options"].length(), 8);
+  EXPECT_EQ(store[0]["options"].Load<uint8_t>(), 0xab);
+  EXPECT_EQ(store[1]["options"].length(), 16);
+  EXPECT_EQ(store[1]["options"].Load<uint16_t>(), 0x1234);
+}
+
+TEST(P4DataStoreTest, Resize) {
+  std::string path = StorePath("resize.p4store");
+  P4DataStore store(path, EntryLayout(), 2);
+  store.Resize(3);
+  store[2]["key"] = uint8_t{1};
+  store.Resize(1);
+  store.Resize(3);
+  EXPECT_EQ(BitLoad(store[2].buffer()->data(), 0, 12), 0);
+  store.Reserve(100);
+  EXPECT_EQ(store.capacity(), 100);
+  EXPECT_EQ(store.size(), 3);
+}
+
+TEST(P4DataStoreTest, Checkpoint) {
+  std::string path = StorePath("checkpoint.p4store");
+  auto layout = EntryLayout();
+  {
+    P4DataStore store(path, layout);
+    EXPECT_EQ(store.checkpoint_size(), 0);
+    EXPECT_TRUE(store.MatchesCheckpoint());
+
+    store.Resize(3);
+    store[1]["value"] = uint64_t{42};
+    EXPECT_FALSE(store.MatchesCheckpoint());
+    store.Checkpoint();
+    EXPECT_EQ(store.checkpoint_size(), 3);
+    EXPECT_TRUE(store.MatchesCheckpoint());
+
+    // Writes after the checkpoint, in place or appended.
+    store[1]["value"] = uint64_t{43};
+    EXPECT_FALSE(store.MatchesCheckpoint());
+    store[1]["value"] = uint64_t{42};
+    EXPECT_TRUE(store.MatchesCheckpoint());
+    store.Append();
+    EXPECT_FALSE(store.MatchesCheckpoint());
+    store.Resize(store.checkpoint_size());
+    EXPECT_TRUE(store.MatchesCheckpoint());
+  }
+
+  // A record torn after the checkpoint, as by a system crash.
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(64 + 7 + 3);
+    file.put('\x5a');
+  }
+  P4DataStore store(path, layout);
+  EXPECT_EQ(store.checkpoint_size(), 3);
+  EXPECT_FALSE(store.MatchesCheckpoint());
+}
+
+TEST(P4DataStoreTest, ReadOnlyAccess) {
+  std::string path = StorePath("readonly.p4store");
+  auto layout = EntryLayout();
+  P4DataStore store(path, layout);
+  store.Append();
+  store[0]["key"] = uint16_t{0x123};
+
+  const P4DataStore& const_store = store;
+  EXPECT_EQ(const_store[0]["key"].Load<uint16_t>(), 0x123);
+  EXPECT_DEATH(const_store[0]["key"].Store(uint16_t{1}), "read-only");
+
+  // Copies write to their own buffer.
+  P4Data copy = const_store[0];
+  copy["key"] = uint16_t{0x456};
+  EXPECT_EQ(store[0]["key"].Load<uint16_t>(), 0x123);
+}
+
+TEST(P4DataStoreTest, AppendOtherType) {
+  std::string path = StorePath("othertype.p4store");
+  P4DataStore store(path, EntryLayout());
+
+  // Same size and no varbits, but not the same type.
+  P4Data other(P4Type(P4StructT{
+                   {"key", P4BitT{16}},
+                   {"value", P4BitT{36}},
+               }),
+               0);
+  EXPECT_DEATH(store.Append(other), "another type");
+
+  // Another layout of the same type is fine.
+  EXPECT_EQ(store.Append(P4Data(EntryLayout(), 0)), 0);
+}
+
+TEST(P4DataStoreTest, LayoutMismatch) {
+  std::string path = StorePath("mismatch.p4store");
+  P4DataStore(path, EntryLayout());
+
+  // Same byte size, different fields.
+  auto other = std::make_shared<const P4Layout>(P4Type(P4StructT{
+      {"key", P4BitT{16}},
+      {"value", P4BitT{36}},
+  }));
+  EXPECT_NE(P4DataStore::Fingerprint(*other),
+            P4DataStore::Fingerprint(*EntryLayout()));
+  EXPECT_THROW(P4DataStore(path, other), std::runtime_error);
+  EXPECT_NO_THROW(P4DataStore(path, EntryLayout()));
+}
+
+TEST(P4DataStoreTest, BadFile) {
+  std::string path = StorePath("bad.p4store");
+  std::ofstream(path) << "not a store";
+  EXPECT_THROW(P4DataStore(path, EntryLayout()), std::runtime_error);
+  EXPECT_THROW(P4DataStore(testing::TempDir() + "/missing/x", EntryLayout()),
+               std::system_error);
+}
+
+}  // namespace
+}  // namespace p4buf
@@ -0,0 +1,187 @@
+#include "p4buf/unpacked.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "absl/base/internal/endian.h"
+#include "absl/log/check.h"
+#include "p4buf/bit.h"
+
+namespace p4buf {
+namespace {
+
+// Loads a piece with a single 8-byte word access.
+inline uint64_t LoadFast(const std::byte* data, std::size_t offset,
+                         std::size_t width) {
+  uint64_t word = absl::big_endian::Load64(data + offset / 8);
+  return (word << (offset % 8)) >> (64 - width);
+}
+
+// Stores a piece with a single 8-byte word access.
+inline void StoreFast(std::byte* data, std::size_t offset, std::size_t width,
+                      uint64_t value) {
+  std::size_t shift = 64 - offset % 8 - width;
+  uint64_t mask = (~uint64_t{0} >> (64 - width)) << shift;
+  uint64_t word = absl::big_endian::Load64(data + offset / 8);
+  word = (word & ~mask) | ((value << shift) & mask);
+  absl::big_endian::Store64(data + offset / 8, word);
+}
+
+}  // namespace
+
+inline uint64_t UnpackedP4Data::Load(const std::byte* data,
+                                     const Piece& piece) {
+  return piece.fast ? LoadFast(data, piece.offset, piece.width)
+                    : BitLoad(data, piece.offset, piece.width);
+}
+
+inline void UnpackedP4Data::Store(std::byte* data, const Piece& piece,
+                                  uint64_t value) {
+  if (piece.fast) {
+    StoreFast(data, piece.offset, piece.width, value);
+  } else {
+    BitStore(data, piece.offset, piece.width, value);
+  }
+}
+
+UnpackedP4Data::UnpackedP4Data(const P4Type& type)
+    : UnpackedP4Data(P4Layout(type)) {}
+
+UnpackedP4Data::UnpackedP4Data(const P4Layout& layout)
+    : byte_size_(layout.byte_size()) {
+  std::size_t num_slots = 0;
+
+  for (std::size_t i = 0; i < layout.num_fields(); ++i) {
+    std::size_t offset = layout.field(i).offset();
+    std::size_t width = layout.field(i).width();
+    widths_.push_back(width);
+    slot_begins_.push_back(num_slots);
+
+    if (layout.is_varbit(layout.field_node(i))) {
+      std::size_t varbit_slots = std::max<std::size_t>((width + 63) / 64, 1);
+      varbits_.push_back({static_cast<uint32_t>(i),
+                          static_cast<uint32_t>(offset),
+                          static_cast<uint32_t>(num_slots),
+                          static_cast<uint32_t>(varbit_slots), 0});
+      num_slots += varbit_slots;
+      continue;
+    }
+
+    // Split the field into 64-bit pieces, leaving the odd bits to the most
+    // significant one.
+    std::size_t piece_width = (width - 1) % 64 + 1;
+    for (std::size_t end = offset + width; offset < end;
+         offset += piece_width, piece_width = 64) {
+      bool fast =
+          offset % 8 + piece_width <= 64 && offset / 8 + 8 <= byte_size_;
+      pieces_.push_back({static_cast<uint32_t>(offset),
+                         static_cast<uint32_t>(num_slots++),
+                         static_cast<uint8_t>(piece_width), fast});
+    }
+    // Even an empty field gets a (constant 0) slot.
+    if (width == 0) {
+      ++num_slots;
+    }
+  }
+
+  slot_begins_.push_back(num_slots);
+  slots_.resize(num_slots, 0);
+}
+
+std::size_t UnpackedP4Data::FindVarbit(std::size_t index) const {
+  auto it = std::lower_bound(
+      varbits_.begin(), varbits_.end(), index,
+      [](const Varbit& varbit, std::size_t index) {
+        return varbit.index < index;
+      });
+  if (it == varbits_.end() || it->index != index) {
+    return varbits_.size();
+  }
+  return it - varbits_.begin();
+}
+
+std::size_t UnpackedP4Data::length(std::size_t index) const {
+  std::size_t varbit = FindVarbit(index);
+  return varbit < varbits_.size() ? varbits_[varbit].length : width(index);
+}
+
+void UnpackedP4Data::set_length(std::size_t index, std::size_t length) {
+  std::size_t varbit = FindVarbit(index);
+  if (varbit == varbits_.size()) {
+    throw std::out_of_range("UnpackedP4Data::set_length: not a varbit");
+  }
+  CHECK(length <= width(index));
+  varbits_[varbit].length = length;
+}
+
+void UnpackedP4Data::Unpack(const Buffer& buffer) {
+  CHECK(buffer.size() >= byte_size_);
+  const std::byte* data = buffer.data();
+  for (const auto& piece : pieces_) {
+    slots_[piece.slot] = Load(data, piece);
+  }
+  for (const auto& varbit : varbits_) {
+    BitLoadWords(data, varbit.offset, varbit.length, &slots_[varbit.slot],
+                 varbit.num_slots);
+  }
+}
+
+void UnpackedP4Data::Unpack(const P4Data& p4data) {
+  CHECK(p4data.buffer() != nullptr);
+  for (std::size_t i = 0; i < varbits_.size(); ++i) {
+    varbits_[i].length = p4data.varbit_length(i);
+  }
+  Unpack(*p4data.buffer());
+}
+
+void UnpackedP4Data::Pack(Buffer& buffer) const {
+  CHECK(buffer.size() >= byte_size_);
+  std::byte* data = buffer.data();
+  if (!buffer.dirty_tracking()) {
+    for (const auto& piece : pieces_) {
+      Store(data, piece, slots_[piece.slot]);
+    }
+    for (const auto& varbit : varbits_) {
+      BitStoreWords(data, varbit.offset, varbit.length, &slots_[varbit.slot],
+                    varbit.num_slots);
+    }
+    return;
+  }
+
+  // Only store and mark pieces whose value changes.
+  for (const auto& piece : pieces_) {
+    uint64_t value = slots_[piece.slot] & (~uint64_t{0} >> (64 - piece.width));
+    if (Load(data, piece) != value) {
+      Store(data, piece, value);
+      buffer.MarkBitsDirty(piece.offset, piece.width);
+    }
+  }
+  // Varbits are compared a word at a time from the least significant end.
+  for (const auto& varbit : varbits_) {
+    const uint64_t* words = &slots_[varbit.slot];
+    bool changed = false;
+    std::size_t remaining = varbit.length;
+    for (std::size_t i = varbit.num_slots; i > 0 && remaining > 0; --i) {
+      std::size_t bits = std::min<std::size_t>(remaining, 64);
+      remaining -= bits;
+      uint64_t value = words[i - 1] & (~uint64_t{0} >> (64 - bits));
+      changed |= BitLoad(data, varbit.offset + remaining, bits) != value;
+    }
+    if (changed) {
+      BitStoreWords(data, varbit.offset, varbit.length, words,
+                    varbit.num_slots);
+      buffer.MarkBitsDirty(varbit.offset, varbit.length);
+    }
+  }
+}
+
+void UnpackedP4Data::Pack(P4Data& p4data) const {
+  Pack(*p4data.mutable_buffer());
+  for (std::size_t i = 0; i < varbits_.size(); ++i) {
+    if (p4data.varbit_length(i) != varbits_[i].length) {
+      p4data.set_varbit_length(i, varbits_[i].length);
+    }
+  }
+}
+
+}  // namespace p4buf
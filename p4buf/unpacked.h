@@ -0,0 +1,133 @@
+// Unpacked (aligned) representation of P4 data.
+
+#ifndef P4BUF_UNPACKED_H_
+#define P4BUF_UNPACKED_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "p4buf/buffer.h"
+#include "p4buf/p4data.h"
+
+namespace p4buf {
+
+// UnpackedP4Data mirrors the bit-packed buffer of a P4 type with one naturally
+// aligned uint64_t slot per leaf field, so that compute-heavy stages can unpack
+// once, operate on plain integers, and pack once at the end.
+//
+// Leaf fields are indexed in their wire order. Each field is right-aligned in
+// its slot. A field wider than 64 bits takes several consecutive slots, with
+// the most significant word first.
+//
+// A varbit field takes slots for its maximum width, holding the value up to its
+// current length right-aligned. The lengths are kept here as well: Unpack and
+// Pack carry them over from and to P4 data, and use the ones kept here for a
+// bare buffer.
+class UnpackedP4Data {
+ public:
+  // Creates an unpacked representation of the given type, with all slots set
+  // to 0.
+  explicit UnpackedP4Data(const P4Type& type);
+
+  // Creates an unpacked representation of the given layout, with all slots set
+  // to 0. Fields share the wire order indices of the layout.
+  explicit UnpackedP4Data(const P4Layout& layout);
+
+  // Loads all fields from the given packed buffer.
+  void Unpack(const Buffer& buffer);
+
+  // Loads all fields from the given P4 data.
+  void Unpack(const P4Data& p4data);
+
+  // Stores all fields into the given packed buffer. Slot bits beyond a field's
+  // width are dropped, and bits outside of any field are left intact. With
+  // dirty tracking on, only fields whose value changes are stored and marked.
+  void Pack(Buffer& buffer) const;
+
+  // Stores all fields into the given P4 data, allocating its buffer (or
+  // copying a shared one) if needed.
+  void Pack(P4Data& p4data) const;
+
+  // Returns a reference to the (first) slot of the field at the given index.
+  uint64_t& operator[](std::size_t index) { return slots_[slot_index(index)]; }
+  const uint64_t& operator[](std::size_t index) const {
+    return slots_[slot_index(index)];
+  }
+
+  // Returns a pointer to the slots of the field at the given index.
+  uint64_t* slots(std::size_t index) { return &slots_[slot_index(index)]; }
+  const uint64_t* slots(std::size_t index) const {
+    return &slots_[slot_index(index)];
+  }
+
+  // Returns the number of slots taken by the field at the given index.
+  std::size_t num_slots(std::size_t index) const {
+    return slot_index(index + 1) - slot_index(index);
+  }
+
+  // Returns the width (in bits) of the field at the given index, which is the
+  // maximum for a varbit.
+  std::size_t width(std::size_t index) const { return widths_.at(index); }
+
+  // Returns the current length (in bits) of the varbit field at the given
+  // index, or the width of any other field.
+  std::size_t length(std::size_t index) const;
+
+  // Sets the current length (in bits) of the varbit field at the given index,
+  // which must not exceed its width. Throws std::out_of_range if the field is
+  // not a varbit.
+  void set_length(std::size_t index, std::size_t length);
+
+  // Returns the number of leaf fields.
+  std::size_t num_fields() const { return widths_.size(); }
+
+  // Returns the size (in bytes) of the packed buffer.
+  std::size_t byte_size() const { return byte_size_; }
+
+ private:
+  // A piece of at most 64 bits, moved between the packed buffer and a slot by
+  // a single load or store. The kernels simply run through all pieces.
+  struct Piece {
+    uint32_t offset;  // In bits, in the packed buffer.
+    uint32_t slot;
+    uint8_t width;
+    // Whether the piece can be moved with one 8-byte word access without
+    // running off the end of the buffer.
+    bool fast;
+  };
+
+  // A varbit field, moved as a whole by the wide kernels.
+  struct Varbit {
+    uint32_t index;   // Of the field.
+    uint32_t offset;  // In bits, in the packed buffer.
+    uint32_t slot;
+    uint32_t num_slots;
+    uint32_t length;
+  };
+
+  // Returns the position in varbits_ of the field at the given index, or
+  // varbits_.size() if it's not a varbit.
+  std::size_t FindVarbit(std::size_t index) const;
+
+  static uint64_t Load(const std::byte* data, const Piece& piece);
+  static void Store(std::byte* data, const Piece& piece, uint64_t value);
+
+  std::size_t slot_index(std::size_t index) const {
+    return slot_begins_.at(index);
+  }
+
+  std::size_t byte_size_ = 0;
+  std::vector<std::size_t> widths_;
+  // One entry per field plus a sentinel, so that field i occupies slots in
+  // [slot_begins_[i], slot_begins_[i + 1]).
+  std::vector<std::size_t> slot_begins_;
+  std::vector<Piece> pieces_;
+  // In field order.
+  std::vector<Varbit> varbits_;
+  std::vector<uint64_t> slots_;
+};
+
+}  // namespace p4buf
+
+#endif  // P4BUF_UNPACKED_H_
@@ -0,0 +1,165 @@
+#include "p4buf/unpacked.h"
+
+#include <gtest/gtest.h>
+
+namespace p4buf {
+
+TEST(UnpackedP4DataTest, UnpackAndPack) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{1}},
+      {"b", P4BitT{2}},
+      {"s",
+       P4StructT{
+           {"c", P4BitT{3}},
+           {"d", P4BitT{4}},
+       }},
+      {"t",
+       P4TupleT{
+           P4BitT{5},
+           P4BitT{6},
+       }},
+  });
+  P4Data p4data(p4type, 0);
+  p4data["/a"] = uint8_t{1};
+  p4data["/b"] = uint8_t{1};
+  p4data["/s/c"] = uint8_t{1};
+  p4data["/s/d"] = uint8_t{1};
+  p4data["/t/0"] = uint8_t{1};
+  p4data["/t/1"] = uint8_t{1};
+
+  UnpackedP4Data unpacked(*p4data.layout());
+  EXPECT_EQ(unpacked.num_fields(), 6);
+  EXPECT_EQ(unpacked.byte_size(), 3);
+
+  unpacked.Unpack(p4data);
+  for (std::size_t i = 0; i < unpacked.num_fields(); ++i) {
+    EXPECT_EQ(unpacked[i], 1);
+  }
+
+  // Increment every field, with overflow bits dropped on pack.
+  for (std::size_t i = 0; i < unpacked.num_fields(); ++i) {
+    unpacked[i] += 1;
+  }
+  unpacked.Pack(p4data);
+
+  // 01001000 10000100 00010000
+  // abbcccdd dd.t[0]. .t[1]
+  const Buffer& buffer = *p4data.buffer();
+  EXPECT_EQ(buffer.at(0), std::byte{0b0100'1000});
+  EXPECT_EQ(buffer.at(1), std::byte{0b1000'0100});
+  EXPECT_EQ(buffer.at(2), std::byte{0b0001'0000});
+}
+
+TEST(UnpackedP4DataTest, WideAndUnalignedFields) {
+  P4Type p4type(P4TupleT{
+      P4BitT{3},
+      P4BitT{64},
+      P4BitT{100},
+      P4BitT{1},
+  });
+  UnpackedP4Data unpacked(p4type);
+  EXPECT_EQ(unpacked.num_fields(), 4);
+  EXPECT_EQ(unpacked.num_slots(0), 1);
+  EXPECT_EQ(unpacked.num_slots(1), 1);
+  EXPECT_EQ(unpacked.num_slots(2), 2);
+  EXPECT_EQ(unpacked.num_slots(3), 1);
+
+  unpacked[0] = 0b101;
+  unpacked[1] = 0x0123'4567'89ab'cdef;
+  unpacked.slots(2)[0] = 0xf'ffff'fff0;
+  unpacked.slots(2)[1] = 0x0fed'cba9'8765'4321;
+  unpacked[3] = 1;
+
+  Buffer buffer(unpacked.byte_size(), 0);
+  unpacked.Pack(buffer);
+
+  UnpackedP4Data round_trip(p4type);
+  round_trip.Unpack(buffer);
+  EXPECT_EQ(round_trip[0], 0b101);
+  EXPECT_EQ(round_trip[1], 0x0123'4567'89ab'cdef);
+  EXPECT_EQ(round_trip.slots(2)[0], 0xf'ffff'fff0);
+  EXPECT_EQ(round_trip.slots(2)[1], 0x0fed'cba9'8765'4321);
+  EXPECT_EQ(round_trip[3], 1);
+
+  // The first byte holds the 3-bit field and the top 5 bits of the next one.
+  EXPECT_EQ(buffer.at(0), std::byte{0b1010'0000});
+  // The last byte holds the last 7 bits of the 100-bit field and the 1-bit one.
+  EXPECT_EQ(buffer.at(buffer.size() - 1), std::byte{0b0100'0011});
+}
+
+TEST(UnpackedP4DataTest, Varbit) {
+  P4Type p4type(P4StructT{
+      {"a", P4BitT{4}},
+      {"options", P4VarbitT{80}},
+      {"b", P4BitT{4}},
+  });
+  P4Data p4data(p4type, 0);
+  p4data["a"] = uint8_t{0x1};
+  p4data["options"] =
+      BitField(std::make_shared<Buffer>(Buffer{0xab, 0xcd, 0xe0}), 0, 20);
+  p4data["b"] = uint8_t{0x2};
+
+  UnpackedP4Data unpacked(*p4data.layout());
+  EXPECT_EQ(unpacked.num_fields(), 3);
+  EXPECT_EQ(unpacked.width(1), 80);
+  EXPECT_EQ(unpacked.num_slots(1), 2);
+  EXPECT_EQ(unpacked.length(0), 4);
+  EXPECT_EQ(unpacked.length(1), 0);
+  EXPECT_THROW(unpacked.set_length(0, 4), std::out_of_range);
+
+  // The value up to the length, right-aligned.
+  unpacked.Unpack(p4data);
+  EXPECT_EQ(unpacked.length(1), 20);
+  EXPECT_EQ(unpacked.slots(1)[0], 0);
+  EXPECT_EQ(unpacked.slots(1)[1], 0xabcde);
+  EXPECT_EQ(unpacked[0], 0x1);
+  EXPECT_EQ(unpacked[2], 0x2);
+
+  // A longer value, and its length, are packed back.
+  unpacked.set_length(1, 72);
+  unpacked.slots(1)[0] = 0xff;
+  unpacked.slots(1)[1] = 0x0123'4567'89ab'cdef;
+  unpacked.Pack(p4data);
+  EXPECT_EQ(p4data["options"].length(), 72);
+  EXPECT_EQ((p4data["options"].Load<WideUint<2>>()),
+            (WideUint<2>{0xff, 0x0123'4567'89ab'cdef}));
+  EXPECT_EQ(p4data["b"].Load<uint8_t>(), 0x2);
+
+  // A bare buffer uses the lengths kept here.
+  Buffer buffer(unpacked.byte_size(), 0);
+  buffer.EnableDirtyTracking();
+  unpacked.set_length(1, 8);
+  unpacked.Pack(buffer);
+  std::vector<std::tuple<std::size_t, std::size_t>> ranges;
+  buffer.ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    ranges.emplace_back(offset, count);
+  });
+  // The fields at bits 0 to 3, 4 to 11 and 84 to 87.
+  std::vector<std::tuple<std::size_t, std::size_t>> want = {{0, 2}, {10, 1}};
+  EXPECT_EQ(ranges, want);
+  EXPECT_EQ(BitLoad(buffer.data(), 4, 8), 0xef);
+}
+
+TEST(UnpackedP4DataTest, PackMarksChangedFieldsDirty) {
+  P4Type p4type(P4TupleT{
+      P4BitT{16},
+      P4BitT{16},
+      P4BitT{16},
+  });
+  Buffer buffer(6, 0);
+  buffer.EnableDirtyTracking();
+
+  UnpackedP4Data unpacked(p4type);
+  unpacked.Unpack(buffer);
+  unpacked[1] = 0xabcd;
+  unpacked.Pack(buffer);
+
+  std::vector<std::tuple<std::size_t, std::size_t>> ranges;
+  buffer.ForEachDirtyRange([&](std::size_t offset, std::size_t count) {
+    ranges.emplace_back(offset, count);
+  });
+  std::vector<std::tuple<std::size_t, std::size_t>> want = {{2, 2}};
+  EXPECT_EQ(ranges, want);
+}
+
+}  // namespace p4buf
@@ -2,6 +2,7 @@
 #define P4BUF_UTILITY_H_
 
 #include <memory>
+#include <utility>
 
 namespace p4buf {
 
@@ -43,6 +44,20 @@ class Box {
   std::unique_ptr<T> ptr_;
 };
 
+// Boxes compare and hash by the objects pointed to.
+template <typename T>
+bool operator==(const Box<T>& lhs, const Box<T>& rhs) {
+  return *lhs == *rhs;
+}
+template <typename T>
+bool operator!=(const Box<T>& lhs, const Box<T>& rhs) {
+  return !(lhs == rhs);
+}
+template <typename H, typename T>
+H AbslHashValue(H h, const Box<T>& box) {
+  return H::combine(std::move(h), *box);
+}
+
 // Helpers for std::visit type-matching. See
 // https://en.cppreference.com/w/cpp/utility/variant/visit.
 template <class... Ts>